@@ -62,6 +62,15 @@ b32 config_read(config_t *config)
 		config->p4.changelistBlockSize = 1000;
 		sb_append(&config->colorscheme, "ImGui Dark");
 	}
+	if(config->version < 2) {
+		config->p4.maxTasksInFlight[0] = 0; // interactive
+		config->p4.maxTasksInFlight[1] = 8; // visible
+		config->p4.maxTasksInFlight[2] = 4; // prefetch
+		config->p4.maxTasksInFlight[3] = 2; // background
+	}
+	if(config->version < 3) {
+		config->p4.blobCacheMaxMB = 512;
+	}
 	config->version = kConfigVersion;
 	config->singleInstanceCheck = false;
 	return ret;
@@ -68,7 +68,8 @@ AUTOJSON typedef struct tag_appTypeConfig {
 AUTOJSON typedef struct tag_p4Config {
 	sb_t clientspec;
 	u32 changelistBlockSize;
-	u8 pad[4];
+	u32 maxTasksInFlight[4]; // indexed by p4TaskPriority, 0 is unlimited
+	u32 blobCacheMaxMB;      // printed revisions kept for diffs, 0 is unlimited
 } p4Config;
 
 AUTOJSON typedef struct tag_changelistConfig {
@@ -127,7 +128,7 @@ AUTOJSON typedef struct config_s {
 	u8 pad[4];
 } config_t;
 
-enum { kConfigVersion = 1,
+enum { kConfigVersion = 3,
 	   kConfigAppTypeVersion = 1 };
 extern config_t g_config;
 extern appTypeConfig g_apptypeConfig;
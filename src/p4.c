@@ -9,7 +9,10 @@
 #include "env_utils.h"
 #include "file_utils.h"
 #include "output.h"
+#include "p4_cache.h"
+#include "p4_shared_cache.h"
 #include "p4_task.h"
+#include "p4_telemetry.h"
 #include "span.h"
 #include "str.h"
 #include "thread_task.h"
@@ -22,11 +25,11 @@ p4_t p4;
 p4Changeset *p4_add_changeset(b32 pending);
 
 const changesetColumnField s_changesetColumnFields[] = {
-	{ "change", kChangesetColumn_Numeric },
-	{ "time", kChangesetColumn_Time },
-	{ "client", kChangesetColumn_Text },
-	{ "user", kChangesetColumn_Text },
-	{ "desc", kChangesetColumn_TextMultiline },
+	{ "change", kChangesetColumn_Numeric, kP4ChangelistColumn_Change },
+	{ "time", kChangesetColumn_Time, kP4ChangelistColumn_Time },
+	{ "client", kChangesetColumn_Text, kP4ChangelistColumn_Client },
+	{ "user", kChangesetColumn_Text, kP4ChangelistColumn_User },
+	{ "desc", kChangesetColumn_TextMultiline, kP4ChangelistColumn_Desc },
 };
 BB_CTASSERT(BB_ARRAYSIZE(s_changesetColumnFields) == BB_ARRAYSIZE(g_config.uiPendingChangesets.columnWidth));
 
@@ -39,8 +42,9 @@ const char *p4_dir(void)
 {
 	const char *configClientspec = sb_get(&g_config.p4.clientspec);
 	for(u32 i = 0; i < p4.localClients.count; ++i) {
-		if(!strcmp(configClientspec, sdict_find_safe(p4.localClients.data + i, "client"))) {
-			return sdict_find_safe(p4.localClients.data + i, "Root");
+		sdict_t *client = p4.allClients.data + p4.localClients.data[i];
+		if(!strcmp(configClientspec, sdict_find_safe(client, "client"))) {
+			return sdict_find_safe(client, "Root");
 		}
 	}
 	const char *root = sdict_find(&p4.info, "clientRoot");
@@ -55,13 +59,19 @@ const char *p4_clientspec(void)
 {
 	const char *configClientspec = sb_get(&g_config.p4.clientspec);
 	for(u32 i = 0; i < p4.localClients.count; ++i) {
-		if(!strcmp(configClientspec, sdict_find_safe(p4.localClients.data + i, "client"))) {
+		if(!strcmp(configClientspec, sdict_find_safe(p4.allClients.data + p4.localClients.data[i], "client"))) {
 			return configClientspec;
 		}
 	}
 	return sdict_find(&p4.info, "clientName");
 }
 
+p4InternId p4_clientspec_id(void)
+{
+	const char *clientspec = p4_clientspec();
+	return clientspec ? p4_intern_find(clientspec) : ~0u;
+}
+
 const char *p4_clientspec_arg(void)
 {
 	const char *clientspec = p4_clientspec();
@@ -120,18 +130,20 @@ void p4_reset_changelist(p4Changelist *cl)
 	sdict_reset(&cl->shelved);
 	sdicts_reset(&cl->normalFiles);
 	sdicts_reset(&cl->shelvedFiles);
+	cl->client = kP4InternId_Empty;
 }
 
 static void p4_reset_changeset(p4Changeset *cs)
 {
-	sdicts_reset(&cs->changelists);
+	p4_changelist_table_reset(&cs->changelists);
+	p4_changelist_table_reset(&cs->newer);
+	p4_changelist_patch_reset(&cs->patch);
 }
 
 void p4_reset_uichangesetentry(p4UIChangesetEntry *e)
 {
 	p4_free_changelist_files(&e->normalFiles);
 	p4_free_changelist_files(&e->shelvedFiles);
-	sb_reset(&e->client);
 }
 
 static void p4_reset_uichangeset(p4UIChangeset *uics)
@@ -142,6 +154,7 @@ static void p4_reset_uichangeset(p4UIChangeset *uics)
 	sb_reset(&uics->config.filterInput);
 	reset_filter_tokens(&uics->autoFilterTokens);
 	reset_filter_tokens(&uics->manualFilterTokens);
+	sb_reset(&uics->serverFilter);
 	for(u32 i = 0; i < uics->entries.count; ++i) {
 		p4_reset_uichangesetentry(uics->entries.data + i);
 	}
@@ -161,6 +174,7 @@ void p4_reset_file_locator(p4FileLocator *locator)
 	sb_reset(&locator->revision);
 }
 
+static void p4_repair_reset(void);
 void p4_shutdown(void)
 {
 	sb_reset(&p4.exe);
@@ -168,16 +182,18 @@ void p4_shutdown(void)
 	sdict_reset(&p4.set);
 	sdicts_reset(&p4.allUsers);
 	sdicts_reset(&p4.allClients);
-	sdicts_reset(&p4.selfClients);
-	sdicts_reset(&p4.localClients);
+	bba_free(p4.selfClients);
+	bba_free(p4.localClients);
 	for(u32 i = 0; i < p4.changelists.count; ++i) {
 		p4_reset_changelist(p4.changelists.data + i);
 	}
 	bba_free(p4.changelists);
 	for(u32 i = 0; i < p4.changesets.count; ++i) {
 		p4_reset_changeset(p4.changesets.data + i);
+		sb_reset(&p4.changesets.data[i].filter);
 	}
 	bba_free(p4.changesets);
+	p4_repair_reset();
 	for(u32 i = 0; i < p4.uiChangesets.count; ++i) {
 		p4_reset_uichangeset(p4.uiChangesets.data + i);
 	}
@@ -187,8 +203,14 @@ void p4_shutdown(void)
 	}
 	bba_free(p4.uiChangelists);
 	p4_reset_file_locator(&p4.diffLeftSide);
+	p4_describe_shutdown();
+	p4_shared_cache_shutdown();
+	p4_task_scheduler_shutdown();
 }
 
+static void p4_remove_unused_filtered_changesets(void);
+static void p4_poll_shared_changeset(void);
+static void p4_poll_change_counter(void);
 void p4_update(void)
 {
 	for(u32 i = 0; i < p4.uiChangelists.count;) {
@@ -209,6 +231,11 @@ void p4_update(void)
 			++i;
 		}
 	}
+	p4_remove_unused_filtered_changesets();
+	p4_describe_flush();
+	p4_poll_shared_changeset();
+	p4_poll_change_counter();
+	p4_task_scheduler_tick();
 }
 
 p4Changelist *p4_find_changelist(u32 cl)
@@ -226,23 +253,24 @@ p4Changelist *p4_find_changelist(u32 cl)
 
 p4Changelist *p4_find_default_changelist(const char *client)
 {
+	p4InternId clientId = p4_intern_find(client);
+	if(clientId == ~0u) {
+		return NULL;
+	}
 	for(u32 i = 0; i < p4.changelists.count; ++i) {
 		p4Changelist *change = p4.changelists.data + i;
-		if(change->number == 0) {
-			const char *changeClient = sdict_find_safe(&change->normal, "client");
-			if(!strcmp(changeClient, client)) {
-				return change;
-			}
+		if(change->number == 0 && change->client == clientId) {
+			return change;
 		}
 	}
 	return NULL;
 }
 
-p4ChangelistType p4_get_changelist_type(sdict_t *cl)
+p4ChangelistType p4_get_changelist_type(const p4Changelist *cl)
 {
 	p4ChangelistType ret = kChangelistType_Submitted;
-	if(!strcmp(sdict_find_safe(cl, "status"), "pending")) {
-		if(!strcmp(sdict_find_safe(cl, "client"), p4_clientspec())) {
+	if(!strcmp(sdict_find_safe(&cl->normal, "status"), "pending")) {
+		if(cl->client == p4_clientspec_id()) {
 			ret = kChangelistType_PendingLocal;
 		} else {
 			ret = kChangelistType_PendingOther;
@@ -262,8 +290,8 @@ static void task_p4clients_statechanged(task *_t)
 	if(_t->state == kTaskState_Succeeded) {
 		task_p4 *t = (task_p4 *)_t->taskData;
 		sdicts_move(&p4.allClients, &t->parsedDicts);
-		sdicts_reset(&p4.selfClients);
-		sdicts_reset(&p4.localClients);
+		p4.selfClients.count = 0;
+		p4.localClients.count = 0;
 		const char *clientHost = sdict_find_safe(&p4.info, "clientHost");
 		const char *userName = sdict_find(&p4.info, "userName");
 		if(userName) {
@@ -271,16 +299,10 @@ static void task_p4clients_statechanged(task *_t)
 				sdict_t *sd = p4.allClients.data + i;
 				const char *user = sdict_find_safe(sd, "Owner");
 				if(!_stricmp(user, userName)) {
-					if(bba_add(p4.selfClients, 1)) {
-						sdict_t *target = &bba_last(p4.selfClients);
-						sdict_copy(target, sd);
-					}
+					bba_push(p4.selfClients, i);
 					const char *host = sdict_find_safe(sd, "Host");
 					if(!_stricmp(host, clientHost)) {
-						if(bba_add(p4.localClients, 1)) {
-							sdict_t *target = &bba_last(p4.localClients);
-							sdict_copy(target, sd);
-						}
+						bba_push(p4.localClients, i);
 					}
 				}
 			}
@@ -293,7 +315,7 @@ static void task_p4users_statechanged(task *_t)
 	if(_t->state == kTaskState_Succeeded) {
 		task_p4 *t = (task_p4 *)_t->taskData;
 		sdicts_move(&p4.allUsers, &t->parsedDicts);
-		task_queue(p4_task_create("refresh_clientspecs", task_p4clients_statechanged, p4_dir(), NULL, "\"%s\" -G clients", p4_exe()));
+		p4_task_queue(kP4TaskPriority_Interactive, p4_task_create("refresh_clientspecs", task_p4clients_statechanged, p4_dir(), NULL, "\"%s\" -G clients", p4_exe()));
 	}
 }
 static void task_p4info_statechanged(task *_t)
@@ -304,7 +326,7 @@ static void task_p4info_statechanged(task *_t)
 		if(t->parsedDicts.count == 1) {
 			sdict_move(&p4.info, t->parsedDicts.data);
 		}
-		task_queue(p4_task_create("refresh_users", task_p4users_statechanged, p4_dir(), NULL, "\"%s\" -G users", p4_exe()));
+		p4_task_queue(kP4TaskPriority_Interactive, p4_task_create("refresh_users", task_p4users_statechanged, p4_dir(), NULL, "\"%s\" -G users", p4_exe()));
 	}
 }
 static void task_p4set_statechanged(task *t)
@@ -338,7 +360,7 @@ static void task_p4set_statechanged(task *t)
 }
 void p4_info(void)
 {
-	task_queue(p4_task_create("refresh_info", task_p4info_statechanged, p4_dir(), NULL, "\"%s\" -G info", p4_exe()));
+	p4_task_queue(kP4TaskPriority_Interactive, p4_task_create("refresh_info", task_p4info_statechanged, p4_dir(), NULL, "\"%s\" -G info", p4_exe()));
 	task setTask = process_task_create("refresh_environment", kProcessSpawn_Tracked, p4_dir(), "\"%s\" set", p4_exe());
 	setTask.stateChanged = task_p4set_statechanged;
 	task_queue(setTask);
@@ -360,182 +382,1177 @@ p4Changeset *p4_find_or_add_changeset(b32 pending)
 {
 	for(u32 i = 0; i < p4.changesets.count; ++i) {
 		p4Changeset *cs = p4.changesets.data + i;
-		if(cs->pending == pending)
+		if(cs->pending == pending && !sb_len(&cs->filter))
 			return cs;
 	}
 	return p4_add_changeset(pending);
 }
 
+static p4Changeset *p4_find_filtered_changeset(const char *filter)
+{
+	for(u32 i = 0; i < p4.changesets.count; ++i) {
+		p4Changeset *cs = p4.changesets.data + i;
+		if(sb_len(&cs->filter) && !strcmp(sb_get(&cs->filter), filter))
+			return cs;
+	}
+	return NULL;
+}
+
+p4Changeset *p4_find_or_add_changeset_for_view(const p4UIChangeset *uics)
+{
+	const char *filter = sb_get(&uics->serverFilter);
+	if(uics->config.pending || !*filter) {
+		return p4_find_or_add_changeset(uics->config.pending);
+	}
+	p4Changeset *cs = p4_find_filtered_changeset(filter);
+	if(!cs) {
+		cs = p4_add_changeset(false);
+		if(cs) {
+			sb_append(&cs->filter, filter);
+		}
+	}
+	return cs;
+}
+
+// Result sets are only kept while a view uses them.  A task still running for one that has been
+// removed finds nothing when it completes, and its results are dropped.
+static void p4_remove_unused_filtered_changesets(void)
+{
+	for(u32 i = 0; i < p4.changesets.count;) {
+		p4Changeset *cs = p4.changesets.data + i;
+		b32 used = !sb_len(&cs->filter);
+		for(u32 j = 0; j < p4.uiChangesets.count && !used; ++j) {
+			const p4UIChangeset *uics = p4.uiChangesets.data + j;
+			used = !uics->config.pending && !strcmp(sb_get(&uics->serverFilter), sb_get(&cs->filter));
+		}
+		if(used) {
+			++i;
+		} else {
+			BB_LOG("p4", "removing filtered changeset - count:%u", cs->changelists.count);
+			p4_reset_changeset(cs);
+			sb_reset(&cs->filter);
+			bba_erase(p4.changesets, i);
+		}
+	}
+}
+
+// the changeset a p4 changes task was started for, or NULL if its result set has since been removed
+static p4Changeset *p4_find_task_changeset(task_p4 *p, b32 pending)
+{
+	const char *filter = sdict_find_safe(&p->extraData, "filter");
+	return *filter ? p4_find_filtered_changeset(filter) : p4_find_or_add_changeset(pending);
+}
+
+// p4 changes tasks dropped from the queue (their views closed) leave the changeset free to fetch again
+static void task_p4changes_dropped(task_p4 *p)
+{
+	p4Changeset *cs = p4_find_task_changeset(p, strtos32(sdict_find_safe(&p->extraData, "pending")));
+	if(cs) {
+		cs->updating = false;
+	}
+}
+
+static void task_p4changes_older_dropped(task_p4 *p)
+{
+	p4Changeset *cs = p4_find_task_changeset(p, false);
+	if(cs) {
+		cs->fetchingHistory = false;
+	}
+}
+
+static void p4_add_task_changeset_filter(sdict_t *extraData, const p4Changeset *cs)
+{
+	if(sb_len(&cs->filter)) {
+		sdict_add_raw(extraData, "filter", sb_get(&cs->filter));
+	}
+}
+
+// The filter's options come first, then one path per line.  p4 changes returns changes under any
+// of the paths, and the range (e.g. "@1,@100", or empty) applies to each of them.
+static sb_t p4_changes_filter_args(const p4Changeset *cs, const char *range)
+{
+	sb_t args = { 0 };
+	const char *filter = sb_get(&cs->filter);
+	const char *paths = strchr(filter, '\n');
+	if(!paths) {
+		paths = filter + strlen(filter);
+	}
+	sb_va(&args, "%.*s", (int)(paths - filter), filter);
+	if(*paths) {
+		const char *cursor = paths;
+		span_t path = tokenize(&cursor, "\n");
+		while(path.start) {
+			sb_va(&args, " \"%.*s%s\"", (int)(path.end - path.start), path.start, range);
+			path = tokenize(&cursor, "\n");
+		}
+	} else if(*range) {
+		sb_va(&args, " //...%s", range);
+	}
+	return args;
+}
+
+// a path:<depot path> token, which the server applies and the client can't - revisions and
+// excluded paths can't be expressed, so those tokens are dropped
+static b32 p4_filter_path_token(span_t token, span_t *path)
+{
+	const char *start = token.start;
+	b32 prohibited = false;
+	if(start < token.end && (*start == '+' || *start == '-')) {
+		prohibited = *start == '-';
+		++start;
+	}
+	const char *category = "path:";
+	size_t categoryLen = strlen(category);
+	if((size_t)(token.end - start) <= categoryLen || _strnicmp(start, category, categoryLen)) {
+		return false;
+	}
+	path->start = start + categoryLen;
+	path->end = token.end;
+	for(const char *c = path->start; c < path->end; ++c) {
+		if(*c == '@' || *c == '#' || *c == '"') {
+			prohibited = true;
+		}
+	}
+	if(prohibited) {
+		path->start = path->end = NULL;
+	}
+	return true;
+}
+
+void p4_build_changes_filter(sb_t *filter, sb_t *clientFilter, const char *user, const char *client, const char *manualFilter)
+{
+	sb_t paths = { 0 };
+	if(clientFilter) {
+		sb_reset(clientFilter);
+	}
+	const char *copied = manualFilter; // the client filter is the text between path: tokens
+	const char *cursor = manualFilter;
+	span_t token = tokenize(&cursor, " ");
+	while(token.start) {
+		span_t path = { 0 };
+		if(p4_filter_path_token(token, &path)) {
+			if(path.start) {
+				sb_va(&paths, "\n%.*s", (int)(path.end - path.start), path.start);
+			}
+			if(clientFilter) {
+				sb_va(clientFilter, "%.*s", (int)(token.start - copied), copied);
+			}
+			copied = token.end;
+		}
+		token = tokenize(&cursor, " ");
+	}
+	if(clientFilter) {
+		sb_append(clientFilter, copied);
+	}
+	if(filter) {
+		sb_reset(filter);
+		if(*user) {
+			sb_va(filter, " -u \"%s\"", user);
+		}
+		if(*client) {
+			sb_va(filter, " -c \"%s\"", client);
+		}
+		sb_append(filter, sb_get(&paths));
+	}
+	sb_reset(&paths);
+}
+
 p4Changeset *p4_add_changeset(b32 pending)
 {
 	if(bba_add(p4.changesets, 1)) {
 		p4Changeset *cs = &bba_last(p4.changesets);
 		cs->pending = pending;
 		cs->highestReceived = 0;
+		cs->lowestReceived = 0;
 		cs->refreshed = false;
 		cs->updating = false;
+		cs->fetchingHistory = false;
 		return cs;
 	}
 	return NULL;
 }
 
-static void p4_save_submitted_changeset(p4Changeset *cs)
+static const char *s_changesetCacheNames[] = { "p4_submitted_changesets", "p4_pending_changesets" };
+static const char *s_submittedUnshardedSnapshotName = "p4_submitted_changesets.snapshot"; // before caches were per server
+static const char *s_submittedUnshardedLogName = "p4_submitted_changesets.log";
+static const char *s_submittedLegacyName = "p4_submitted_changesets.bin"; // marshal, before snapshots
+
+typedef struct tag_changesetCacheState {
+	u32 logSize; // submitted only - pending lists are small enough to rewrite
+	b32 saving;
+	b32 saveQueued; // another save was requested while one was running - the latest table wins
+	b32 warmStarted; // pending only - the saved list has been loaded (or found missing)
+	u64 snapshotTime; // submitted only - write time of the snapshot in memory, to notice another instance replacing it
+	u32 checkpointCount; // submitted only - rows in the last snapshot saved while paging in history
+	u8 pad[4];
+} changesetCacheState;
+static changesetCacheState s_changesetCaches[2]; // submitted, pending
+
+static changesetCacheState *p4_changeset_cache(const p4Changeset *cs)
+{
+	return s_changesetCaches + (cs->pending ? 1 : 0);
+}
+
+static sb_t p4_cache_path(const char *filename)
 {
 	sb_t path = appdata_get("p4t");
-	sb_append(&path, "\\p4_submitted_changesets.bin");
-	BB_LOG("p4::cache", "begin save submitted changelists - path:%s", sb_get(&path));
-	BB_FLUSH();
+	sb_va(&path, "\\%s", filename);
+	return path;
+}
+
+// Changelist caches are kept per server and user, side by side, so switching servers (or between
+// a server and its replica) loads that server's history instead of replacing it.
+static void p4_cache_append_shard_name(sb_t *path, const char *name)
+{
+	for(const char *c = name; *c; ++c) {
+		char ch = *c;
+		b32 safe = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '-' || ch == '_' || ch == '.';
+		sb_append_char(path, safe ? ch : '_');
+	}
+}
+
+sb_t p4_cache_shard_path(const char *name, const char *extension)
+{
+	const char *server = sdict_find_safe(&p4.info, "serverID");
+	if(!*server) {
+		server = sdict_find_safe(&p4.info, "serverAddress");
+	}
+	if(!*server) {
+		server = sdict_find_safe(&p4.set, "P4PORT");
+	}
+	const char *user = sdict_find_safe(&p4.info, "userName");
+	sb_t path = appdata_get("p4t");
+	sb_va(&path, "\\%s.", name);
+	p4_cache_append_shard_name(&path, *server ? server : "unknown");
+	sb_append_char(&path, '@');
+	p4_cache_append_shard_name(&path, *user ? user : "unknown");
+	if(extension) {
+		sb_va(&path, ".%s", extension);
+	}
+	return path;
+}
 
-	pyWriter pw = { 0 };
-	b32 built = py_write_sdicts(&pw, &cs->changelists);
-	b32 wrote = false;
-	if(built) {
-		fileData_t fd = { 0 };
-		fd.buffer = pw.data;
-		fd.bufferSize = pw.count;
-		if(fd.buffer && path.data) {
-			wrote = fileData_writeIfChanged(path.data, NULL, fd);
+static sb_t p4_changeset_cache_path(b32 pending, const char *extension)
+{
+	return p4_cache_shard_path(s_changesetCacheNames[pending ? 1 : 0], extension);
+}
+
+// Other instances can share the caches (see p4_shared_cache.h), so only the elected writer saves
+// them or fetches newer changes - the rest follow the files.
+static b32 p4_changeset_cache_writer(void)
+{
+	sb_t key = p4_cache_shard_path("p4_changesets", NULL);
+	b32 writer = p4_shared_cache_elect(sb_get(&key));
+	sb_reset(&key);
+	return writer;
+}
+
+static void p4_changeset_cache_snapshot_time(changesetCacheState *cache, const char *path)
+{
+	u64 size;
+	p4_shared_cache_file_info(path, &cache->snapshotTime, &size);
+}
+
+u32 p4_pending_change_time(u32 change)
+{
+	for(u32 i = 0; i < p4.changesets.count; ++i) {
+		const p4Changeset *cs = p4.changesets.data + i;
+		if(cs->pending) {
+			for(u32 row = 0; row < cs->changelists.count; ++row) {
+				if(cs->changelists.change[row] == change) {
+					return cs->changelists.time[row];
+				}
+			}
 		}
 	}
+	return 0;
+}
+
+// Saves write a copy of the table on a worker thread, so the UI thread only pays for the copy.
+typedef struct tag_cachedChangesetSave {
+	sb_t path;
+	sb_t logPath;
+	p4ChangelistTable changelists;
+	u32 minChange;
+	u32 maxChange;
+	u32 telemetryId;
+	b32 pending;
+} cachedChangesetSave;
+static bb_thread_return_t p4_save_cached_changeset_thread(void *args)
+{
+	task_thread *th = args;
+	cachedChangesetSave *data = th->data;
+	p4_telemetry_spawned(data->telemetryId);
+	u64 writeStart = p4_telemetry_ticks();
+	b32 wrote = p4_cache_write_snapshot(sb_get(&data->path), &data->changelists, data->minChange, data->maxChange);
 	if(wrote) {
-		BB_LOG("p4::cache", "end save submitted changelists - count:%u highest:%u built:%u wrote:%u", cs->changelists.count, cs->highestReceived, built, wrote);
-	} else {
-		BB_ERROR("p4::cache", "end save submitted changelists - count:%u highest:%u built:%u wrote:%u", cs->changelists.count, cs->highestReceived, built, wrote);
+		p4_telemetry_output(data->telemetryId, data->changelists.descriptions.count, data->changelists.count, p4_telemetry_ticks() - writeStart);
+	}
+	th->threadDesiredState = wrote ? kTaskState_Succeeded : kTaskState_Failed;
+	return 0;
+}
+static void p4_save_changeset(p4Changeset *cs);
+static void p4_save_cached_changeset_statechanged(task *t)
+{
+	task_thread_statechanged(t);
+	if(task_done(t)) {
+		task_thread *th = t->taskData;
+		cachedChangesetSave *data = th->data;
+		p4_telemetry_done(data->telemetryId, t->state);
+		changesetCacheState *cache = s_changesetCaches + (data->pending ? 1 : 0);
+		cache->saving = false;
+		p4Changeset *cs = p4_find_or_add_changeset(data->pending);
+		if(t->state == kTaskState_Succeeded) {
+			if(!data->pending) {
+				// the snapshot covers everything up to maxChange, so the log only needs what arrived since
+				file_delete(sb_get(&data->logPath));
+				cache->logSize = 0;
+				p4_changeset_cache_snapshot_time(cache, sb_get(&data->path));
+				if(cs && !cache->saveQueued) {
+					p4_cache_append_log(sb_get(&data->logPath), &cs->changelists, data->maxChange, &cache->logSize);
+				}
+				const char *oldNames[] = { s_submittedUnshardedSnapshotName, s_submittedUnshardedLogName, s_submittedLegacyName };
+				for(u32 i = 0; i < BB_ARRAYSIZE(oldNames); ++i) {
+					sb_t oldPath = p4_cache_path(oldNames[i]);
+					file_delete(sb_get(&oldPath));
+					sb_reset(&oldPath);
+				}
+			}
+			BB_LOG("p4::cache", "end save %s changelists - count:%u highest:%u log:%u", data->pending ? "pending" : "submitted",
+			       data->changelists.count, data->maxChange, cache->logSize);
+		} else {
+			BB_ERROR("p4::cache", "end save %s changelists - count:%u highest:%u state:%d", data->pending ? "pending" : "submitted",
+			         data->changelists.count, data->maxChange, t->state);
+		}
+		p4_changelist_table_reset(&data->changelists);
+		sb_reset(&data->path);
+		sb_reset(&data->logPath);
+		free(data);
+		th->data = NULL;
+		if(cs && cache->saveQueued) {
+			cache->saveQueued = false;
+			p4_save_changeset(cs);
+		}
+	}
+}
+static b32 p4_repair_holds_save(const p4Changeset *cs);
+static void p4_save_changeset(p4Changeset *cs)
+{
+	changesetCacheState *cache = p4_changeset_cache(cs);
+	if(sb_len(&cs->filter) || !p4_changeset_cache_writer() || p4_repair_holds_save(cs)) {
+		return;
+	}
+	if(cache->saving) {
+		cache->saveQueued = true;
+		return;
+	}
+	cachedChangesetSave *data = malloc(sizeof(cachedChangesetSave));
+	if(!data) {
+		return;
+	}
+	memset(data, 0, sizeof(cachedChangesetSave));
+	if(p4_changelist_table_copy(&data->changelists, &cs->changelists)) {
+		data->pending = cs->pending;
+		data->path = p4_changeset_cache_path(cs->pending, "snapshot");
+		data->logPath = p4_changeset_cache_path(cs->pending, "log");
+		data->minChange = cs->pending ? 0 : BB_MAX(cs->lowestReceived, 1u);
+		data->maxChange = cs->highestReceived;
+		BB_LOG("p4::cache", "begin save %s changelists - path:%s count:%u highest:%u log:%u", cs->pending ? "pending" : "submitted",
+		       sb_get(&data->path), data->changelists.count, data->maxChange, cache->logSize);
+		data->telemetryId = p4_telemetry_begin("save_cached_changelists", sb_get(&data->path), kP4TaskPriority_Background);
+		p4_telemetry_started(data->telemetryId);
+		if(task_queue(thread_task_create("save_cached_changelists", p4_save_cached_changeset_statechanged, p4_save_cached_changeset_thread, data))) {
+			cache->saving = true;
+			return;
+		}
+		p4_telemetry_done(data->telemetryId, kTaskState_Failed);
+	}
+	BB_ERROR("p4::cache", "failed to start saving %s changelists - count:%u highest:%u", cs->pending ? "pending" : "submitted",
+	         cs->changelists.count, cs->highestReceived);
+	p4_changelist_table_reset(&data->changelists);
+	sb_reset(&data->path);
+	sb_reset(&data->logPath);
+	free(data);
+}
+
+// appends changelists newer than afterChange to the log, and folds the log into the snapshot once it is large
+static void p4_append_submitted_changeset(p4Changeset *cs, u32 afterChange)
+{
+	changesetCacheState *cache = p4_changeset_cache(cs);
+	if(sb_len(&cs->filter) || !p4_changeset_cache_writer()) {
+		return;
+	}
+	sb_t logPath = p4_changeset_cache_path(false, "log");
+	b32 wrote = logPath.data && p4_cache_append_log(sb_get(&logPath), &cs->changelists, afterChange, &cache->logSize);
+	sb_reset(&logPath);
+	if(!wrote) {
+		BB_ERROR("p4::cache", "failed to append submitted changelists after %u - rewriting snapshot", afterChange);
+		p4_save_changeset(cs);
+	} else if(cache->logSize > kP4Cache_CompactLogSize && !cache->saving) {
+		p4_save_changeset(cs);
 	}
-	BB_FLUSH();
-	bba_free(pw);
-	sb_reset(&path);
 }
+
+// Loading maps the snapshot on one thread, then decodes its segments on several.  Rows are stored
+// newest first, and each run of finished segments from the front is shown as soon as it's decoded,
+// so the top of the Submitted view fills in while the rest of the history is still loading.
+enum {
+	kCachedChangesetLoad_MaxThreads = 4,
+};
+
 typedef struct tag_cachedChangesetLoad {
 	sb_t path;
-	sdicts dicts;
+	sb_t logPath;
+	sb_t unshardedPath;
+	sb_t unshardedLogPath;
+	sb_t legacyPath;
+	p4SnapshotReader reader;       // set if a snapshot was found
+	p4Records logRecords;          // appended once every segment is in
+	p4ChangelistTable changelists; // the legacy cache, which is read whole
+	u32 maxChange;
+	u32 telemetryId;
+	u32 logSize;
+	b32 rewrite; // loaded from an older cache or a damaged log, which should be replaced with a snapshot
+	u8 *segmentsDone;
+	u8 *segmentsDamaged; // decoded with rows out of range, which were blanked until they are refetched
+	u32 numDamaged;
+	u32 nextSegment;
+	u32 publishedSegments;
+	u32 runningSegments;
+	b32 failed;
+	u8 pad[4];
 } cachedChangesetLoad;
+
+typedef struct tag_cachedChangesetSegment {
+	cachedChangesetLoad *load;
+	p4InternId *user;
+	p4InternId *client;
+	u32 segment;
+	u32 count;
+	b32 damaged;
+	u8 pad[4];
+} cachedChangesetSegment;
+
+static void p4_load_cached_changeset_reset(cachedChangesetLoad *data)
+{
+	sb_reset(&data->path);
+	sb_reset(&data->logPath);
+	sb_reset(&data->unshardedPath);
+	sb_reset(&data->unshardedLogPath);
+	sb_reset(&data->legacyPath);
+	p4_snapshot_reader_reset(&data->reader);
+	p4_records_reset(&data->logRecords);
+	p4_changelist_table_reset(&data->changelists);
+	free(data->segmentsDone);
+	free(data->segmentsDamaged);
+	free(data);
+}
+
+static b32 p4_load_cached_snapshot(cachedChangesetLoad *data, const sb_t *path, const sb_t *logPath)
+{
+	if(!p4_snapshot_reader_open(&data->reader, sb_get(path))) {
+		return false;
+	}
+	data->maxChange = data->reader.header->maxChange;
+	if(!data->reader.segments) {
+		data->rewrite = true; // from before checksums
+	}
+	if(!p4_cache_read_log(sb_get(logPath), &data->logRecords, &data->logSize)) {
+		data->rewrite = true;
+	}
+	return true;
+}
 bb_thread_return_t p4_load_cached_changeset_thread(void *args)
 {
 	task_thread *th = args;
 	cachedChangesetLoad *data = th->data;
-	pyParser parser = { 0 };
-	fileData_t fd = fileData_read(sb_get(&data->path));
-	if(fd.buffer && !th->shouldTerminate) {
-		parser.cmdline = sb_get(&data->path);
-		parser.data = fd.buffer;
-		parser.count = fd.bufferSize;
-		while(py_parser_tick(&parser, &data->dicts, false) && !th->shouldTerminate) {
-			// do nothing
-		}
-		// don't bba_free(parser) because the memory is borrowed from fd
-		fileData_reset(&fd);
-	}
-	sdict_reset(&parser.dict);
+	p4_telemetry_spawned(data->telemetryId);
+	u64 parseStart = p4_telemetry_ticks();
+	if(p4_load_cached_snapshot(data, &data->path, &data->logPath)) {
+		p4_telemetry_output(data->telemetryId, data->logSize, data->logRecords.count, p4_telemetry_ticks() - parseStart);
+	} else if(!th->shouldTerminate && p4_load_cached_snapshot(data, &data->unshardedPath, &data->unshardedLogPath)) {
+		data->rewrite = true;
+		p4_telemetry_output(data->telemetryId, data->logSize, data->logRecords.count, p4_telemetry_ticks() - parseStart);
+	} else if(!th->shouldTerminate && p4_cache_read_legacy(sb_get(&data->legacyPath), &data->changelists, &data->maxChange)) {
+		data->rewrite = true;
+		p4_telemetry_output(data->telemetryId, data->changelists.descriptions.count, data->changelists.count, p4_telemetry_ticks() - parseStart);
+	}
+	th->threadDesiredState = th->shouldTerminate ? kTaskState_Canceled : kTaskState_Succeeded;
+	return 0;
+}
+
+static void p4_load_cached_changeset_done(cachedChangesetLoad *data, p4Changeset *cs)
+{
+	if(cs) {
+		cs->updating = false;
+		if(cs->refreshed) {
+			p4_request_newer_changes(cs, g_config.p4.changelistBlockSize);
+		} else {
+			p4_refresh_changelist_no_cache(cs);
+		}
+	}
+	p4_load_cached_changeset_reset(data);
+}
+
+// Once a snapshot is loaded, its checksums are compared on a worker thread.  Each run of damaged
+// segments - those that fail their checksums, had rows out of range when decoded or are past the
+// end of a truncated file - is refetched by the change range it covers and merged into the
+// changeset, so a bad block on disk costs a few p4 changes calls rather than the whole history.
+typedef struct tag_cachedChangesetValidate {
+	p4SnapshotReader reader;
+	u8 *damaged; // per segment
+	u32 numDamaged;
+	b32 headerValid;
+	u32 telemetryId;
+	u8 pad[4];
+} cachedChangesetValidate;
+
+static bb_thread_return_t p4_validate_cached_changeset_thread(void *args)
+{
+	task_thread *th = args;
+	cachedChangesetValidate *data = th->data;
+	p4_telemetry_spawned(data->telemetryId);
+	u64 verifyStart = p4_telemetry_ticks();
+	data->headerValid = p4_snapshot_reader_verify_header(&data->reader);
+	for(u32 segment = 0; segment < data->reader.numSegments && !th->shouldTerminate; ++segment) {
+		if(data->damaged[segment]) {
+			continue; // failed to decode
+		}
+		if(!data->headerValid || !p4_snapshot_reader_verify(&data->reader, segment)) {
+			data->damaged[segment] = true;
+			++data->numDamaged;
+		}
+	}
+	p4_telemetry_output(data->telemetryId, 0, data->reader.numSegments, p4_telemetry_ticks() - verifyStart);
+	th->threadDesiredState = th->shouldTerminate ? kTaskState_Canceled : kTaskState_Succeeded;
+	return 0;
+}
+
+// A damaged segment's rows can't be trusted - not even their change numbers - so they are
+// dropped by row, and their change range is refetched a page at a time, newest first.  Pages are
+// kept aside until every range is in, then merged in one go.  Runs of damaged segments are
+// repaired one at a time, and the whole repair is given up if the rows move in the meantime (the
+// snapshot was reloaded), since the row ranges no longer mean anything.
+typedef struct tag_changesetRepairRange {
+	u32 firstRow;
+	u32 endRow;
+	u32 firstChange; // the change column at firstRow and endRow - 1 when the damage was found, to
+	u32 lastChange;  // notice the rows moving
+	u32 low;
+	u32 high; // 0 for everything from low on
+} changesetRepairRange;
+
+typedef struct tag_changesetRepairRanges {
+	u32 count;
+	u32 allocated;
+	changesetRepairRange *data;
+} changesetRepairRanges;
+
+typedef struct tag_changesetRepair {
+	changesetRepairRanges ranges;
+	p4ChangelistTable fetched;
+	u32 nextRange;
+	b32 active;
+} changesetRepair;
+static changesetRepair s_changesetRepair;
+
+static void p4_repair_reset(void)
+{
+	bba_free(s_changesetRepair.ranges);
+	p4_changelist_table_reset(&s_changesetRepair.fetched);
+	s_changesetRepair.nextRange = 0;
+	s_changesetRepair.active = false;
+}
+
+static b32 p4_repair_rows_unchanged(const p4Changeset *cs)
+{
+	for(u32 i = 0; i < s_changesetRepair.ranges.count; ++i) {
+		const changesetRepairRange *range = s_changesetRepair.ranges.data + i;
+		if(range->endRow > cs->changelists.count || cs->changelists.change[range->firstRow] != range->firstChange ||
+		   cs->changelists.change[range->endRow - 1] != range->lastChange) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int p4_repair_change_compare(const void *_a, const void *_b)
+{
+	u32 a = *(const u32 *)_a;
+	u32 b = *(const u32 *)_b;
+	return (a < b) ? -1 : (a > b);
+}
+
+// Rows known to be damaged (blanked or failing their checksums) mustn't be saved over the snapshot,
+// where they would get fresh checksums and pass from then on.  A repair that fails leaves them in
+// place, and saves held, until the next load finds the damage again.
+static b32 p4_repair_holds_save(const p4Changeset *cs)
+{
+	return !cs->pending && s_changesetRepair.ranges.count && p4_repair_rows_unchanged(cs);
+}
+
+// returns true if the changeset should be saved
+static b32 p4_repair_apply(p4Changeset *cs)
+{
+	p4ChangelistTable fresh = { 0 };
+	u32 rangeIndex = 0;
+	for(u32 row = 0; row < cs->changelists.count; ++row) {
+		while(rangeIndex < s_changesetRepair.ranges.count && row >= s_changesetRepair.ranges.data[rangeIndex].endRow) {
+			++rangeIndex;
+		}
+		if(rangeIndex >= s_changesetRepair.ranges.count || row < s_changesetRepair.ranges.data[rangeIndex].firstRow) {
+			p4_changelist_table_add_row(&fresh, &cs->changelists, row);
+		}
+	}
+
+	// the ranges are refetched whole, so skip anything the rows that were kept already have
+	u32 numKept = fresh.count;
+	u32 *kept = malloc(sizeof(u32) * BB_MAX(numKept, 1u));
+	if(kept) {
+		memcpy(kept, fresh.change, sizeof(u32) * numKept);
+		qsort(kept, numKept, sizeof(u32), p4_repair_change_compare);
+	}
+	const p4ChangelistTable *fetched = &s_changesetRepair.fetched;
+	for(u32 row = 0; row < fetched->count; ++row) {
+		u32 change = fetched->change[row];
+		if(!kept || !bsearch(&change, kept, numKept, sizeof(u32), p4_repair_change_compare)) {
+			p4_changelist_table_add_row(&fresh, fetched, row);
+		}
+	}
+	free(kept);
+
+	u32 received = fetched->count;
+	p4ChangelistReconcile reconcile = p4_changelist_table_reconcile(&cs->changelists, &fresh, NULL);
+	if(reconcile == kP4ChangelistReconcile_Patched || reconcile == kP4ChangelistReconcile_Replaced) {
+		++cs->parity;
+	}
+	// the damaged rows may have raised it
+	cs->highestReceived = 0;
+	for(u32 row = 0; row < cs->changelists.count; ++row) {
+		cs->highestReceived = BB_MAX(cs->highestReceived, cs->changelists.change[row]);
+	}
+	BB_LOG("p4::cache", "repaired %u damaged ranges of submitted changelists - received:%u result:%d", s_changesetRepair.ranges.count,
+	       received, reconcile);
+	return reconcile != kP4ChangelistReconcile_Unchanged;
+}
+
+static void p4_repair_request_page(u32 low, u32 high);
+static void task_p4changes_repair_statechanged(task *t)
+{
+	task_process_statechanged(t);
+	if(task_done(t)) {
+		task_p4 *p = (task_p4 *)t->taskData;
+		u32 pageSize = strtou32(sdict_find_safe(&p->extraData, "pageSize"));
+		u32 low = strtou32(sdict_find_safe(&p->extraData, "low"));
+		u32 high = strtou32(sdict_find_safe(&p->extraData, "high")); // 0 for everything from low on
+		p4Changeset *cs = p4_find_or_add_changeset(false);
+		if(!cs || !cs->refreshed || t->state != kTaskState_Succeeded || !p4_repair_rows_unchanged(cs)) {
+			BB_ERROR("p4::cache", "gave up repairing submitted changelists %u-%u - state:%d", low, high, t->state);
+			if(cs && cs->refreshed && p4_repair_rows_unchanged(cs)) {
+				// the damaged rows are still there - keep their ranges so saves stay held
+				p4_changelist_table_reset(&s_changesetRepair.fetched);
+				s_changesetRepair.active = false;
+			} else {
+				p4_repair_reset();
+			}
+			return;
+		}
+		u32 oldest = ~0u;
+		for(u32 i = 0; i < p->records.count; ++i) {
+			u32 number = strtou32(p4_record_find_safe(&p->records, i, "change"));
+			if(number >= low && (!high || number <= high)) {
+				p4_changelist_table_add_record(&s_changesetRepair.fetched, &p->records, i);
+				oldest = BB_MIN(oldest, number);
+			}
+		}
+		if(pageSize && p->records.count >= pageSize && oldest != ~0u && oldest > low) {
+			p4_repair_request_page(low, oldest - 1);
+		} else if(s_changesetRepair.nextRange < s_changesetRepair.ranges.count) {
+			const changesetRepairRange *range = s_changesetRepair.ranges.data + s_changesetRepair.nextRange++;
+			p4_repair_request_page(range->low, range->high);
+		} else {
+			b32 changed = p4_repair_apply(cs);
+			p4_repair_reset();
+			if(changed) {
+				p4_save_changeset(cs);
+			}
+		}
+	}
+}
+
+static void p4_repair_request_page(u32 low, u32 high)
+{
+	u32 pageSize = g_config.p4.changelistBlockSize;
+	sdict_t extraData = { 0 };
+	sdict_add_raw(&extraData, "pageSize", va("%u", pageSize));
+	sdict_add_raw(&extraData, "low", va("%u", low));
+	sdict_add_raw(&extraData, "high", va("%u", high));
+	const char *range = high ? va("@%u,@%u", low, high) : va("@%u,@now", low);
+	task t = pageSize ? p4_task_create("repair_changelists", task_p4changes_repair_statechanged, p4_dir(), &extraData,
+	                                   "\"%s\" -G changes -s submitted -l -m %u //...%s", p4_exe(), pageSize, range)
+	                  : p4_task_create("repair_changelists", task_p4changes_repair_statechanged, p4_dir(), &extraData,
+	                                   "\"%s\" -G changes -s submitted -l //...%s", p4_exe(), range);
+	p4_task_use_records(&t);
+	if(!p4_task_queue(kP4TaskPriority_Background, t)) {
+		BB_ERROR("p4::cache", "failed to start repairing submitted changelists %u-%u", low, high);
+		p4_repair_reset();
+	}
+}
+
+static void p4_repair_submitted_changes(void)
+{
+	if(s_changesetRepair.ranges.count) {
+		s_changesetRepair.active = true;
+		const changesetRepairRange *range = s_changesetRepair.ranges.data + s_changesetRepair.nextRange++;
+		p4_repair_request_page(range->low, range->high);
+	}
+}
+
+static void p4_validate_cached_changeset_statechanged(task *t)
+{
+	task_thread_statechanged(t);
+	if(task_done(t)) {
+		task_thread *th = t->taskData;
+		cachedChangesetValidate *data = th->data;
+		th->data = NULL;
+		p4_telemetry_done(data->telemetryId, t->state);
+		p4Changeset *cs = p4_find_or_add_changeset(false);
+		if(s_changesetRepair.ranges.count) {
+			p4_repair_reset(); // a repair of the previous load - its rows are gone
+		}
+		if(t->state == kTaskState_Succeeded && data->numDamaged && cs && cs->refreshed) {
+			BB_ERROR("p4::cache", "snapshot has %u of %u segments damaged%s - refetching them", data->numDamaged, data->reader.numSegments,
+			         data->headerValid ? "" : " (header)");
+			const p4SnapshotSegment *segments = data->reader.segments;
+			u32 numSegments = data->reader.numSegments;
+			u32 segmentStart = 0;
+			for(u32 first = 0; first < numSegments; ++first) {
+				u32 firstRow = segmentStart;
+				segmentStart += p4_snapshot_reader_segment_count(&data->reader, first);
+				if(!data->damaged[first]) {
+					continue;
+				}
+				u32 last = first;
+				while(last + 1 < numSegments && data->damaged[last + 1]) {
+					++last;
+					segmentStart += p4_snapshot_reader_segment_count(&data->reader, last);
+				}
+				// the neighbours passed, so their ranges can be trusted where the damaged ones can't
+				changesetRepairRange range = { 0 };
+				range.firstRow = firstRow;
+				range.endRow = BB_MIN(segmentStart, cs->changelists.count);
+				range.low = (last + 1 < numSegments) ? segments[last + 1].highChange + 1 : BB_MAX(cs->lowestReceived, 1u);
+				range.high = first ? segments[first - 1].lowChange - 1 : 0;
+				if(range.endRow > range.firstRow && (!range.high || range.high >= range.low)) {
+					range.firstChange = cs->changelists.change[range.firstRow];
+					range.lastChange = cs->changelists.change[range.endRow - 1];
+					bba_push(s_changesetRepair.ranges, range);
+				}
+				first = last;
+			}
+			p4_repair_submitted_changes();
+		} else {
+			BB_LOG("p4::cache", "validated submitted changelists - segments:%u damaged:%u state:%d", data->reader.numSegments, data->numDamaged, t->state);
+		}
+		p4_snapshot_reader_reset(&data->reader);
+		free(data->damaged);
+		free(data);
+	}
+}
+
+// takes over the load's reader and the segments that failed to decode, so the mapping stays
+// alive while it is checked
+static void p4_validate_cached_changeset(cachedChangesetLoad *load)
+{
+	if(!load->reader.segments || !load->reader.numSegments) {
+		return;
+	}
+	cachedChangesetValidate *data = malloc(sizeof(cachedChangesetValidate));
+	if(!data) {
+		return;
+	}
+	memset(data, 0, sizeof(*data));
+	data->damaged = load->segmentsDamaged;
+	data->numDamaged = load->numDamaged;
+	load->segmentsDamaged = NULL;
+	if(data->damaged) {
+		data->reader = load->reader;
+		memset(&load->reader, 0, sizeof(load->reader));
+		data->telemetryId = p4_telemetry_begin("validate_cached_changelists", "", kP4TaskPriority_Background);
+		p4_telemetry_started(data->telemetryId);
+		if(task_queue(thread_task_create("validate_cached_changelists", p4_validate_cached_changeset_statechanged, p4_validate_cached_changeset_thread, data))) {
+			return;
+		}
+		p4_telemetry_done(data->telemetryId, kTaskState_Failed);
+		p4_snapshot_reader_reset(&data->reader);
+	}
+	free(data->damaged);
+	free(data);
+}
+
+// all segments are decoded (or one failed) - add the log and hand the changeset over
+static void p4_load_cached_changeset_finish(cachedChangesetLoad *data)
+{
+	p4Changeset *cs = p4_find_or_add_changeset(false);
+	b32 attached = cs && cs->changelists.mapped == data->reader.mapped;
+	p4_telemetry_done(data->telemetryId, data->failed ? kTaskState_Failed : kTaskState_Succeeded);
+	if(attached && !data->failed) {
+		p4_cache_apply_log(&cs->changelists, &data->logRecords, &cs->highestReceived);
+		p4_changeset_cache(cs)->logSize = data->logSize;
+		p4_changeset_cache_snapshot_time(p4_changeset_cache(cs), sb_get(&data->path));
+		BB_LOG("p4::cache", "end load submitted changelists - count:%u highest:%u segments:%u damaged:%u log:%u", cs->changelists.count,
+		       cs->highestReceived, data->reader.numSegments, data->numDamaged, data->logSize);
+		if(data->rewrite && !data->numDamaged) {
+			p4_save_changeset(cs); // removes older caches once the snapshot is written - a repair saves instead
+		}
+		p4_validate_cached_changeset(data);
+	} else {
+		BB_ERROR("p4::cache", "end load submitted changelists - failed after %u of %u segments", data->publishedSegments, data->reader.numSegments);
+		if(attached) {
+			++cs->parity;
+			cs->refreshed = false;
+			cs->highestReceived = 0;
+			p4_reset_changeset(cs);
+		}
+	}
+	p4_load_cached_changeset_done(data, cs);
+}
+
+static bb_thread_return_t p4_load_cached_segment_thread(void *args)
+{
+	task_thread *th = args;
+	cachedChangesetSegment *segment = th->data;
+	u64 decodeStart = p4_telemetry_ticks();
+	segment->damaged = !p4_snapshot_reader_decode(&segment->load->reader, segment->segment, segment->user, segment->client);
+	p4_telemetry_output(segment->load->telemetryId, 0, segment->count, p4_telemetry_ticks() - decodeStart);
 	th->threadDesiredState = th->shouldTerminate ? kTaskState_Canceled : kTaskState_Succeeded;
 	return 0;
 }
+static void p4_load_cached_segment_statechanged(task *t);
+static void p4_load_cached_queue_segments(cachedChangesetLoad *data)
+{
+	while(!data->failed && data->runningSegments < kCachedChangesetLoad_MaxThreads && data->nextSegment < data->reader.numSegments) {
+		cachedChangesetSegment *segment = malloc(sizeof(cachedChangesetSegment));
+		if(segment) {
+			memset(segment, 0, sizeof(*segment));
+			segment->load = data;
+			segment->segment = data->nextSegment;
+			segment->count = p4_snapshot_reader_segment_count(&data->reader, segment->segment);
+			segment->user = malloc(BB_MAX(segment->count, 1u) * sizeof(p4InternId));
+			segment->client = malloc(BB_MAX(segment->count, 1u) * sizeof(p4InternId));
+		}
+		if(segment && segment->user && segment->client &&
+		   task_queue(thread_task_create("load_cached_segment", p4_load_cached_segment_statechanged, p4_load_cached_segment_thread, segment))) {
+			++data->runningSegments;
+			++data->nextSegment;
+		} else {
+			if(segment) {
+				free(segment->user);
+				free(segment->client);
+				free(segment);
+			}
+			data->failed = true;
+		}
+	}
+}
+static void p4_load_cached_segment_statechanged(task *t)
+{
+	task_thread_statechanged(t);
+	if(task_done(t)) {
+		task_thread *th = t->taskData;
+		cachedChangesetSegment *segment = th->data;
+		cachedChangesetLoad *data = segment->load;
+		--data->runningSegments;
+		p4Changeset *cs = p4_find_or_add_changeset(false);
+		if(t->state == kTaskState_Succeeded && !data->failed && cs && cs->changelists.mapped == data->reader.mapped) {
+			u32 firstRow = segment->segment * data->reader.segmentRows;
+			memcpy(cs->changelists.user + firstRow, segment->user, segment->count * sizeof(p4InternId));
+			memcpy(cs->changelists.client + firstRow, segment->client, segment->count * sizeof(p4InternId));
+			data->segmentsDone[segment->segment] = true;
+			if(segment->damaged) {
+				// repaired by range once the load is done - snapshots without segments have no ranges
+				data->segmentsDamaged[segment->segment] = true;
+				++data->numDamaged;
+				data->failed = !data->reader.segments;
+			}
+			u32 published = data->publishedSegments;
+			while(published < data->reader.numSegments && data->segmentsDone[published]) {
+				++published;
+			}
+			if(published != data->publishedSegments) {
+				// the UI appends rows past the count it has seen, so this doesn't rebuild the view
+				data->publishedSegments = published;
+				cs->changelists.count = BB_MIN(published * data->reader.segmentRows, data->reader.header->count);
+			}
+		} else {
+			data->failed = true;
+		}
+		free(segment->user);
+		free(segment->client);
+		free(segment);
+		th->data = NULL;
+
+		p4_load_cached_queue_segments(data);
+		if(!data->runningSegments) {
+			p4_load_cached_changeset_finish(data);
+		}
+	}
+}
+
 void p4_load_cached_changeset_statechanged(task *t)
 {
 	task_thread_statechanged(t);
 	if(task_done(t)) {
+		u64 callbackStart = p4_telemetry_ticks();
 		p4Changeset *cs = p4_find_or_add_changeset(false);
-		cs->updating = false;
 		task_thread *th = t->taskData;
 		cachedChangesetLoad *data = th->data;
-		if(cs && data->dicts.count && t->state == kTaskState_Succeeded) {
+		th->data = NULL;
+		u32 telemetryId = data->telemetryId;
+		b32 succeeded = cs && t->state == kTaskState_Succeeded;
+		if(succeeded && data->reader.mapped) {
 			p4_reset_changeset(cs);
 			++cs->parity;
-			cs->refreshed = true;
-			sdicts_move(&cs->changelists, &data->dicts);
-			for(u32 i = 0; i < cs->changelists.count; ++i) {
-				sdict_t *sd = cs->changelists.data + i;
-				u32 number = strtou32(sdict_find(sd, "change"));
-				cs->highestReceived = BB_MAX(cs->highestReceived, number);
+			data->segmentsDone = calloc(BB_MAX(data->reader.numSegments, 1u), 1);
+			data->segmentsDamaged = calloc(BB_MAX(data->reader.numSegments, 1u), 1);
+			if(data->segmentsDone && data->segmentsDamaged && p4_snapshot_reader_borrow(&data->reader, &cs->changelists)) {
+				cs->refreshed = true;
+				cs->highestReceived = data->maxChange;
+				cs->lowestReceived = p4_snapshot_reader_min_change(&data->reader);
+				BB_LOG("p4::cache", "begin decode submitted changelists - count:%u segments:%u", data->reader.header->count, data->reader.numSegments);
+				p4_load_cached_queue_segments(data);
+				if(!data->runningSegments) {
+					p4_load_cached_changeset_finish(data);
+				}
+			} else {
+				p4_telemetry_done(telemetryId, kTaskState_Failed);
+				p4_load_cached_changeset_done(data, cs);
 			}
-			BB_LOG("p4::cache", "end load submitted changelists - count:%u highest:%u", cs->changelists.count, cs->highestReceived);
 		} else {
-			BB_LOG("p4::cache", "end load submitted changelists - no data");
+			p4_telemetry_done(telemetryId, t->state);
+			if(succeeded && data->changelists.count) {
+				p4_reset_changeset(cs);
+				++cs->parity;
+				cs->refreshed = true;
+				p4_changelist_table_move(&cs->changelists, &data->changelists);
+				cs->highestReceived = data->maxChange;
+				cs->lowestReceived = 1;
+				BB_LOG("p4::cache", "end load submitted changelists - count:%u highest:%u legacy:1", cs->changelists.count, cs->highestReceived);
+				if(data->rewrite) {
+					p4_save_changeset(cs); // removes older caches once the snapshot is written
+				}
+			} else {
+				BB_LOG("p4::cache", "end load submitted changelists - no data");
+			}
+			p4_load_cached_changeset_done(data, cs);
 		}
 		BB_FLUSH();
-		sdicts_reset(&data->dicts);
-		sb_reset(&data->path);
-		free(data);
-		th->data = NULL;
+		p4_telemetry_callback(telemetryId, p4_telemetry_ticks() - callbackStart);
+	}
+}
+
+// Pages of history are saved as they arrive, so a backfill that is interrupted picks up from the
+// oldest page saved.  Each save rewrites the whole snapshot, so they are spaced out as it grows.
+static void p4_checkpoint_history(p4Changeset *cs)
+{
+	changesetCacheState *cache = p4_changeset_cache(cs);
+	if(sb_len(&cs->filter)) {
+		return; // filtered result sets are only kept in memory
+	}
+	if(cs->lowestReceived <= 1 || !cache->checkpointCount || cs->changelists.count >= cache->checkpointCount + cache->checkpointCount / 4) {
+		cache->checkpointCount = BB_MAX(cs->changelists.count, 1u);
+		p4_save_changeset(cs);
+	}
+}
 
+static void task_p4changes_older_statechanged(task *t)
+{
+	task_process_statechanged(t);
+	if(task_done(t)) {
+		task_p4 *p = (task_p4 *)t->taskData;
+		u32 pageSize = strtou32(sdict_find_safe(&p->extraData, "pageSize"));
+		u32 high = strtou32(sdict_find_safe(&p->extraData, "high"));
+		p4Changeset *cs = p4_find_task_changeset(p, false);
 		if(cs) {
-			if(cs->refreshed) {
-				p4_request_newer_changes(cs, g_config.p4.changelistBlockSize);
-			} else {
-				p4_refresh_changelist_no_cache(cs);
+			cs->fetchingHistory = false;
+			// a reload may have started since - the view asks for the page again once it's done
+			if(t->state == kTaskState_Succeeded && cs->refreshed && !cs->updating && cs->lowestReceived == high + 1) {
+				u32 oldest = cs->lowestReceived;
+				for(u32 i = 0; i < p->records.count; ++i) {
+					u32 number = strtou32(p4_record_find_safe(&p->records, i, "change"));
+					if(number && number <= high) {
+						// rows are appended, so the view adds them without a rebuild
+						p4_changelist_table_add_record(&cs->changelists, &p->records, i);
+						oldest = BB_MIN(oldest, number);
+					}
+				}
+				cs->lowestReceived = (p->records.count >= pageSize && oldest > 1) ? oldest : 1;
+				BB_LOG("p4", "received submitted history %u-%u - count:%u", cs->lowestReceived, high, cs->changelists.count);
+				p4_checkpoint_history(cs);
 			}
 		}
 	}
 }
 
+void p4_request_older_changes(p4Changeset *cs)
+{
+	u32 pageSize = g_config.p4.changelistBlockSize;
+	// updating covers a snapshot that is still being decoded - adding rows before the last segment
+	// is in would drop the mapping the remaining segments are decoded into
+	if(cs->pending || !cs->refreshed || cs->updating || cs->fetchingHistory || cs->lowestReceived <= 1 || !pageSize) {
+		return;
+	}
+	sdict_t extraData = { 0 };
+	sdict_add_raw(&extraData, "pageSize", va("%u", pageSize));
+	sdict_add_raw(&extraData, "high", va("%u", cs->lowestReceived - 1));
+	p4_add_task_changeset_filter(&extraData, cs);
+	sb_t args = p4_changes_filter_args(cs, va("@1,@%u", cs->lowestReceived - 1));
+	task t = p4_task_create("find_older_changelists", task_p4changes_older_statechanged, p4_dir(), &extraData,
+	                        "\"%s\" -G changes -s submitted -l -m %u%s", p4_exe(), pageSize, sb_get(&args));
+	sb_reset(&args);
+	p4_task_use_records(&t);
+	p4_task_set_dropped(&t, task_p4changes_older_dropped);
+	if(p4_task_queue(kP4TaskPriority_Visible, t)) {
+		cs->fetchingHistory = true;
+	}
+}
+
 static void task_p4changes_refresh_statechanged(task *t)
 {
 	task_process_statechanged(t);
 	if(task_done(t)) {
-		b32 pending = strtos32(sdict_find_safe(&t->extraData, "pending"));
-		p4Changeset *cs = p4_find_or_add_changeset(pending);
+		task_p4 *p = (task_p4 *)t->taskData;
+		b32 pending = strtos32(sdict_find_safe(&p->extraData, "pending"));
+		p4Changeset *cs = p4_find_task_changeset(p, pending);
 		if(cs) {
 			cs->updating = false;
 			if(t->state == kTaskState_Succeeded) {
-				++cs->parity;
 				cs->refreshed = true;
-				p4_reset_changeset(cs);
-				task_p4 *p = (task_p4 *)t->taskData;
-				sdicts_move(&cs->changelists, &p->parsedDicts);
-				for(u32 i = 0; i < cs->changelists.count; ++i) {
-					sdict_t *sd = cs->changelists.data + i;
-					u32 number = strtou32(sdict_find(sd, "change"));
-					cs->highestReceived = BB_MAX(cs->highestReceived, number);
-				}
 				if(pending) {
+					// reconcile with what is shown (possibly the cached list) rather than rebuilding it
+					p4ChangelistTable fresh = { 0 };
+					p4_changelist_table_add_records(&fresh, &p->records);
 					for(u32 clientIdx = 0; clientIdx < p4.allClients.count; ++clientIdx) {
 						sdict_t *clientDict = p4.allClients.data + clientIdx;
 						const char *client = sdict_find(clientDict, "client");
 						const char *owner = sdict_find(clientDict, "Owner");
 						if(client && owner) {
-							if(bba_add(cs->changelists, 1)) {
-								sdict_t *sd = &bba_last(cs->changelists);
-								p4_build_default_changelist(sd, owner, client);
-							}
+							sdict_t sd = { 0 };
+							p4_build_default_changelist(&sd, owner, client);
+							p4Records records = { 0 };
+							p4_records_add_sdict(&records, &sd);
+							p4_changelist_table_add_records(&fresh, &records);
+							p4_records_reset(&records);
+							sdict_reset(&sd);
 						}
 					}
+					// patched rows are followed by the views, so selection and expansion survive a refresh
+					p4ChangelistReconcile reconcile = p4_changelist_table_reconcile(&cs->changelists, &fresh, &cs->patch);
+					if(reconcile == kP4ChangelistReconcile_Patched) {
+						++cs->patchCount;
+					} else if(reconcile == kP4ChangelistReconcile_Replaced) {
+						++cs->parity;
+					}
+					cs->stale = false;
+					cs->highestReceived = 0;
+					for(u32 i = 0; i < cs->changelists.count; ++i) {
+						cs->highestReceived = BB_MAX(cs->highestReceived, cs->changelists.change[i]);
+					}
+					BB_LOG("p4::cache", "reconciled pending changelists - count:%u result:%d", cs->changelists.count, reconcile);
+					if(reconcile != kP4ChangelistReconcile_Unchanged) {
+						p4_save_changeset(cs);
+					}
 				} else {
-					p4_save_submitted_changeset(cs);
+					++cs->parity;
+					p4_reset_changeset(cs);
+					p4_changelist_table_add_records(&cs->changelists, &p->records);
+					u32 pageSize = strtou32(sdict_find_safe(&p->extraData, "pageSize"));
+					u32 oldest = ~0u;
+					for(u32 i = 0; i < cs->changelists.count; ++i) {
+						cs->highestReceived = BB_MAX(cs->highestReceived, cs->changelists.change[i]);
+						oldest = BB_MIN(oldest, cs->changelists.change[i]);
+					}
+					cs->lowestReceived = (pageSize && p->records.count >= pageSize && oldest > 1) ? oldest : 1;
+					if(!sb_len(&cs->filter)) {
+						p4_changeset_cache(cs)->checkpointCount = 0;
+						p4_checkpoint_history(cs);
+					}
 				}
 			}
 		}
 	}
 }
+// Without a cache, submitted history starts with the newest page.  Older pages are fetched by
+// p4_request_older_changes as the view needs them.
 void p4_refresh_changelist_no_cache(p4Changeset *cs)
 {
 	if(!cs->updating && p4.allClients.count > 0) {
-		task *t = task_queue(
-		    p4_task_create(
-		        "refresh_changelists",
-		        task_p4changes_refresh_statechanged, p4_dir(), NULL,
-		        "\"%s\" -G changes -s %s -l", p4_exe(), cs->pending ? "pending" : "submitted"));
-		if(t) {
+		u32 pageSize = cs->pending ? 0 : g_config.p4.changelistBlockSize;
+		sdict_t extraData = { 0 };
+		sdict_add_raw(&extraData, "pending", cs->pending ? "1" : "0");
+		sdict_add_raw(&extraData, "pageSize", va("%u", pageSize));
+		p4_add_task_changeset_filter(&extraData, cs);
+		sb_t args = p4_changes_filter_args(cs, "");
+		task t = pageSize ? p4_task_create("refresh_changelists", task_p4changes_refresh_statechanged, p4_dir(), &extraData,
+		                                   "\"%s\" -G changes -s submitted -l -m %u%s", p4_exe(), pageSize, sb_get(&args))
+		                  : p4_task_create("refresh_changelists", task_p4changes_refresh_statechanged, p4_dir(), &extraData,
+		                                   "\"%s\" -G changes -s %s -l%s", p4_exe(), cs->pending ? "pending" : "submitted", sb_get(&args));
+		sb_reset(&args);
+		p4_task_use_records(&t);
+		p4_task_set_dropped(&t, task_p4changes_dropped);
+		if(p4_task_queue(cs->pending ? kP4TaskPriority_Visible : kP4TaskPriority_Background, t)) {
 			cs->updating = true;
-			sdict_add_raw(&t->extraData, "pending", cs->pending ? "1" : "0");
 		}
 	}
 }
+// Pending changelists start from the list saved last time, shown as stale until the refresh
+// reconciles it.  The list is small, so it's mapped on the UI thread as soon as p4 info has
+// identified the server, without waiting for users and clients.
+static void p4_load_cached_pending_changeset(p4Changeset *cs)
+{
+	changesetCacheState *cache = p4_changeset_cache(cs);
+	if(cache->warmStarted || cs->updating || cs->changelists.count || !p4.info.count) {
+		return;
+	}
+	cache->warmStarted = true;
+	sb_t path = p4_changeset_cache_path(true, "snapshot");
+	u32 maxChange = 0;
+	if(path.data && p4_cache_open_snapshot(sb_get(&path), &cs->changelists, &maxChange)) {
+		++cs->parity;
+		cs->highestReceived = maxChange;
+		BB_LOG("p4::cache", "loaded pending changelists - count:%u path:%s", cs->changelists.count, sb_get(&path));
+		cs->stale = true;
+	}
+	sb_reset(&path);
+}
+
 void p4_refresh_changeset(p4Changeset *cs)
 {
+	if(cs->pending) {
+		p4_load_cached_pending_changeset(cs);
+	}
 	if(!cs->updating && p4.allClients.count > 0) {
 		cs->highestReceived = 0;
 		cs->refreshed = false;
 		if(cs->pending) {
+			cs->stale = cs->changelists.count != 0;
+			p4_refresh_changelist_no_cache(cs);
+		} else if(sb_len(&cs->filter)) {
 			p4_refresh_changelist_no_cache(cs);
 		} else {
 			if(!cs->refreshed) {
 				cachedChangesetLoad *data = malloc(sizeof(cachedChangesetLoad));
 				if(data) {
 					memset(data, 0, sizeof(cachedChangesetLoad));
-					data->path = appdata_get("p4t");
-					sb_append(&data->path, "\\p4_submitted_changesets.bin");
+					data->path = p4_changeset_cache_path(false, "snapshot");
+					data->logPath = p4_changeset_cache_path(false, "log");
+					data->unshardedPath = p4_cache_path(s_submittedUnshardedSnapshotName);
+					data->unshardedLogPath = p4_cache_path(s_submittedUnshardedLogName);
+					data->legacyPath = p4_cache_path(s_submittedLegacyName);
 					BB_LOG("p4::cache", "begin load submitted changelists - path:%s", sb_get(&data->path));
 					BB_FLUSH();
+					data->telemetryId = p4_telemetry_begin("load_cached_changelists", sb_get(&data->path), kP4TaskPriority_Background);
+					p4_telemetry_started(data->telemetryId);
 					task *t = task_queue(
 					    thread_task_create("load_cached_changelists", p4_load_cached_changeset_statechanged, p4_load_cached_changeset_thread, data));
 					if(t) {
@@ -550,69 +1567,231 @@ void p4_refresh_changeset(p4Changeset *cs)
 	}
 }
 
+// Newer changes are fetched exactly: everything above highestReceived, a page at a time, newest
+// first.  A full page means there may be more below it, so the next page asks for the changes
+// between highestReceived and the oldest one received.  Pages are held in cs->newer until the last
+// one is in, then added to the table and highestReceived moves.  An interrupted fetch leaves
+// neither a gap nor rows that the next fetch, starting from the same place, would add again.
+static void p4_request_newer_changes_page(p4Changeset *cs, u32 pageSize, u32 low, u32 high, u32 top);
 static void task_p4changes_newer_statechanged(task *t)
 {
 	task_process_statechanged(t);
 	if(task_done(t)) {
-		u32 blockSize = strtou32(sdict_find_safe(&t->extraData, "blockSize"));
-		p4Changeset *cs = p4_find_or_add_changeset(false);
+		task_p4 *p = (task_p4 *)t->taskData;
+		u32 pageSize = strtou32(sdict_find_safe(&p->extraData, "pageSize"));
+		u32 low = strtou32(sdict_find_safe(&p->extraData, "low"));
+		u32 high = strtou32(sdict_find_safe(&p->extraData, "high")); // 0 for the first page, up to now
+		u32 top = strtou32(sdict_find_safe(&p->extraData, "top"));
+		p4Changeset *cs = p4_find_task_changeset(p, false);
 		if(cs) {
 			cs->updating = false;
-			if(t->state == kTaskState_Succeeded) {
-				b32 complete = false;
-				task_p4 *p = (task_p4 *)t->taskData;
-				for(u32 i = 0; i < p->parsedDicts.count; ++i) {
-					sdict_t *sd = p->parsedDicts.data + i;
-					u32 number = strtou32(sdict_find(sd, "change"));
-					if(number == cs->highestReceived) {
-						complete = true;
-						break;
+			if(t->state == kTaskState_Succeeded && cs->refreshed && cs->highestReceived + 1 == low) {
+				u32 oldest = ~0u;
+				if(!high) {
+					p4_changelist_table_reset(&cs->newer); // left by an interrupted fetch
+				}
+				for(u32 i = 0; i < p->records.count; ++i) {
+					u32 number = strtou32(p4_record_find_safe(&p->records, i, "change"));
+					if(number >= low && (!high || number <= high)) {
+						p4_changelist_table_add_record(&cs->newer, &p->records, i);
+						top = BB_MAX(top, number);
+						oldest = BB_MIN(oldest, number);
 					}
 				}
-				if(complete) {
-					b32 added = false;
-					u32 highestReceived = cs->highestReceived;
-					for(u32 i = 0; i < p->parsedDicts.count; ++i) {
-						sdict_t *sd = p->parsedDicts.data + i;
-						u32 number = strtou32(sdict_find(sd, "change"));
-						if(number > cs->highestReceived) {
-							if(bba_add(cs->changelists, 1)) {
-								sdict_t *target = &bba_last(cs->changelists);
-								sdict_move(target, sd);
-								added = true;
-								highestReceived = BB_MAX(highestReceived, number);
-							}
-						}
+				if(p->records.count >= pageSize && oldest != ~0u && oldest > low) {
+					p4_request_newer_changes_page(cs, pageSize, low, oldest - 1, top);
+				} else if(top >= low) {
+					for(u32 row = 0; row < cs->newer.count; ++row) {
+						p4_changelist_table_add_row(&cs->changelists, &cs->newer, row);
 					}
-					if(added) {
+					if(cs->newer.count) {
 						++cs->parity;
-						cs->highestReceived = highestReceived;
-						p4_save_submitted_changeset(cs);
 					}
-				} else {
-					p4_request_newer_changes(cs, blockSize * 2);
+					p4_changelist_table_reset(&cs->newer);
+					u32 previousHighest = cs->highestReceived;
+					cs->highestReceived = top;
+					BB_LOG("p4", "received submitted changelists %u-%u", low, top);
+					p4_append_submitted_changeset(cs, previousHighest);
+				}
+			}
+		}
+	}
+}
+static void p4_request_newer_changes_page(p4Changeset *cs, u32 pageSize, u32 low, u32 high, u32 top)
+{
+	sdict_t extraData = { 0 };
+	sdict_add_raw(&extraData, "pageSize", va("%u", pageSize));
+	sdict_add_raw(&extraData, "low", va("%u", low));
+	sdict_add_raw(&extraData, "high", va("%u", high));
+	sdict_add_raw(&extraData, "top", va("%u", top));
+	p4_add_task_changeset_filter(&extraData, cs);
+	sb_t args = p4_changes_filter_args(cs, high ? va("@%u,@%u", low, high) : va("@%u,@now", low));
+	task t = p4_task_create("find_newer_changelists", task_p4changes_newer_statechanged, p4_dir(), &extraData,
+	                        "\"%s\" -G changes -s submitted -l -m %u%s", p4_exe(), pageSize, sb_get(&args));
+	sb_reset(&args);
+	p4_task_use_records(&t);
+	p4_task_set_dropped(&t, task_p4changes_dropped);
+	if(p4_task_queue(kP4TaskPriority_Visible, t)) {
+		cs->updating = true;
+	}
+}
+
+// Instances that aren't the writer pick up what the writer has appended to the log.  If the writer
+// has folded the log into a new snapshot, rows between what is in memory and the new snapshot are
+// only in the snapshot, so it is loaded again.
+static void p4_sync_shared_changeset(p4Changeset *cs)
+{
+	changesetCacheState *cache = p4_changeset_cache(cs);
+	sb_t path = p4_changeset_cache_path(false, "snapshot");
+	sb_t logPath = p4_changeset_cache_path(false, "log");
+	u64 snapshotTime, snapshotSize, logTime, logSize;
+	p4_shared_cache_file_info(sb_get(&path), &snapshotTime, &snapshotSize);
+	p4_shared_cache_file_info(sb_get(&logPath), &logTime, &logSize);
+	if(snapshotTime && snapshotTime != cache->snapshotTime) {
+		BB_LOG("p4::cache", "shared snapshot was replaced - reloading submitted changelists");
+		++cs->parity;
+		cs->refreshed = false;
+		cs->highestReceived = 0;
+		p4_reset_changeset(cs);
+		p4_refresh_changeset(cs);
+	} else if(logSize != cache->logSize) {
+		p4Records records = { 0 };
+		u32 previousCount = cs->changelists.count;
+		p4_cache_read_log(sb_get(&logPath), &records, &cache->logSize);
+		p4_cache_apply_log(&cs->changelists, &records, &cs->highestReceived);
+		p4_records_reset(&records);
+		if(cs->changelists.count != previousCount) {
+			++cs->parity;
+			BB_LOG("p4::cache", "synced %u submitted changelists from the shared log - highest:%u", cs->changelists.count - previousCount,
+			       cs->highestReceived);
+		}
+	}
+	sb_reset(&path);
+	sb_reset(&logPath);
+}
+
+static u64 s_sharedCachePollTicks;
+enum {
+	kSharedCache_PollMs = 1000,
+};
+
+// readers follow the writer's files, and the writer fetches when a reader asks (or when it has
+// just taken over from a writer that exited)
+static void p4_poll_shared_changeset(void)
+{
+	u64 now = GetTickCount64();
+	if(!p4.info.count || now - s_sharedCachePollTicks < kSharedCache_PollMs) {
+		return;
+	}
+	s_sharedCachePollTicks = now;
+	p4Changeset *cs = NULL;
+	for(u32 i = 0; i < p4.changesets.count; ++i) {
+		if(!p4.changesets.data[i].pending && !sb_len(&p4.changesets.data[i].filter)) {
+			cs = p4.changesets.data + i;
+			break;
+		}
+	}
+	if(!cs || !cs->refreshed || cs->updating) {
+		return;
+	}
+	b32 wasWriter = p4_shared_cache_is_writer();
+	if(p4_changeset_cache_writer()) {
+		if(!wasWriter || p4_shared_cache_refresh_requested()) {
+			p4_request_newer_changes(cs, g_config.p4.changelistBlockSize);
+		}
+	} else {
+		p4_sync_shared_changeset(cs);
+	}
+}
+
+// The change counter moves whenever a changelist is created or submitted, so polling it is a cheap
+// way to find out there is something to fetch.  The interval backs off while it stays put, and
+// drops back to the minimum once it moves.  Each changeset records the counter it last fetched
+// at, so one that was busy when the counter moved catches up on a later poll without the others
+// fetching again.
+enum {
+	kChangeCounter_MinIntervalMs = 15 * 1000,
+	kChangeCounter_MaxIntervalMs = 5 * 60 * 1000,
+};
+typedef struct tag_changeCounterPoll {
+	u64 nextTicks;
+	u32 intervalMs;
+	u32 value; // 0 until the first poll
+	b32 inFlight;
+	u8 pad[4];
+} changeCounterPoll;
+static changeCounterPoll s_changeCounter;
+
+static void task_p4counter_change_statechanged(task *t)
+{
+	task_process_statechanged(t);
+	if(task_done(t)) {
+		task_p4 *p = (task_p4 *)t->taskData;
+		s_changeCounter.inFlight = false;
+		u32 value = (t->state == kTaskState_Succeeded && p->records.count) ? strtou32(p4_record_find_safe(&p->records, 0, "value")) : 0;
+		u32 intervalMs = BB_MIN(s_changeCounter.intervalMs * 2, (u32)kChangeCounter_MaxIntervalMs);
+		if(value) {
+			u32 previous = s_changeCounter.value;
+			b32 behind = false; // busy when the counter moved - polled again at the minimum interval
+			if(previous && value != previous) {
+				BB_LOG("p4", "change counter moved from %u to %u", previous, value);
+			}
+			for(u32 i = 0; i < p4.changesets.count; ++i) {
+				p4Changeset *cs = p4.changesets.data + i;
+				if(!cs->changeCounter) {
+					cs->changeCounter = previous ? previous : value; // opened since the last poll
 				}
+				if(!cs->refreshed) {
+					cs->changeCounter = value; // the refresh fetches everything
+				} else if(cs->changeCounter != value) {
+					if(cs->updating) {
+						behind = true;
+					} else {
+						p4_request_newer_changes(cs, g_config.p4.changelistBlockSize);
+						cs->changeCounter = value;
+					}
+				}
+			}
+			if(value != previous || behind) {
+				s_changeCounter.value = value;
+				intervalMs = kChangeCounter_MinIntervalMs;
 			}
 		}
+		s_changeCounter.intervalMs = intervalMs;
+		s_changeCounter.nextTicks = GetTickCount64() + intervalMs;
+	}
+}
+
+static void p4_poll_change_counter(void)
+{
+	u64 now = GetTickCount64();
+	if(s_changeCounter.inFlight || now < s_changeCounter.nextTicks || !p4.info.count || !p4.allClients.count) {
+		return;
+	}
+	if(!s_changeCounter.intervalMs) {
+		s_changeCounter.intervalMs = kChangeCounter_MinIntervalMs;
+	}
+	task t = p4_task_create("poll_change_counter", task_p4counter_change_statechanged, p4_dir(), NULL, "\"%s\" -G counter change", p4_exe());
+	p4_task_use_records(&t);
+	if(p4_task_queue(kP4TaskPriority_Background, t)) {
+		s_changeCounter.inFlight = true;
+	} else {
+		s_changeCounter.nextTicks = now + s_changeCounter.intervalMs;
 	}
 }
+
 void p4_request_newer_changes(p4Changeset *cs, u32 blockSize)
 {
 	if(!cs->updating) {
 		if(cs->pending) {
 			p4_refresh_changeset(cs);
+		} else if(cs->refreshed && !sb_len(&cs->filter) && !p4_changeset_cache_writer()) {
+			p4_shared_cache_request_refresh();
+			p4_sync_shared_changeset(cs);
 		} else {
-			BB_LOG("p4", "requesting newer submitted changelists - blockSize is %u", blockSize);
-			if(blockSize) {
-				task *t = task_queue(
-				    p4_task_create(
-				        "find_newer_changelists",
-				        task_p4changes_newer_statechanged, p4_dir(), NULL,
-				        "\"%s\" -G changes -s submitted -l -m %u", p4_exe(), blockSize));
-				if(t) {
-					cs->updating = true;
-					sdict_add_raw(&t->extraData, "blockSize", va("%u", blockSize));
-				}
+			BB_LOG("p4", "requesting submitted changelists above %u - page size is %u", cs->highestReceived, blockSize);
+			if(blockSize && cs->refreshed) {
+				p4_request_newer_changes_page(cs, blockSize, cs->highestReceived + 1, 0, 0);
 			} else {
 				p4_refresh_changeset(cs);
 			}
@@ -626,12 +1805,22 @@ static inline const char *p4_get_uichangesetentry_sort_key(const p4UIChangesetEn
 {
 	u32 columnIndex = s_sortConfig->sortColumn;
 	const changesetColumnField *field = s_changesetColumnFields + columnIndex;
-	sdict_t *sd = s_sortChangeset->changelists.data + e->changelistIndex;
-	const char *str = sdict_find_safe(sd, field->key);
-	if(field->type == kChangesetColumn_Numeric) {
-		str = (const char *)(ptrdiff_t)atoi(str);
+	const p4ChangelistTable *table = &s_sortChangeset->changelists;
+	u32 row = e->changelistIndex;
+	switch(field->column) {
+	case kP4ChangelistColumn_Change:
+		return (const char *)(ptrdiff_t)table->change[row];
+	case kP4ChangelistColumn_Time:
+		return (const char *)(ptrdiff_t)table->time[row];
+	case kP4ChangelistColumn_Client:
+		return p4_intern_string(table->client[row]);
+	case kP4ChangelistColumn_User:
+		return p4_intern_string(table->user[row]);
+	case kP4ChangelistColumn_Desc:
+	case kP4ChangelistColumn_Count:
+		break;
 	}
-	return str;
+	return p4_changelist_table_desc(table, row);
 }
 static int p4_changeset_compare(const void *_a, const void *_b)
 {
@@ -644,9 +1833,9 @@ static int p4_changeset_compare(const void *_a, const void *_b)
 	u32 columnIndex = s_sortConfig->sortColumn;
 	const changesetColumnField *field = s_changesetColumnFields + columnIndex;
 	int val;
-	if(field->type == kChangesetColumn_Numeric) {
-		int aint = (int)(ptrdiff_t)astr;
-		int bint = (int)(ptrdiff_t)bstr;
+	if(field->type == kChangesetColumn_Numeric || field->type == kChangesetColumn_Time) {
+		u32 aint = (u32)(ptrdiff_t)astr;
+		u32 bint = (u32)(ptrdiff_t)bstr;
 		if(aint < bint) {
 			val = -1;
 		} else if(aint > bint) {
@@ -665,13 +1854,7 @@ static int p4_changeset_compare(const void *_a, const void *_b)
 }
 void p4_sort_uichangeset(p4UIChangeset *uics)
 {
-	for(u32 i = 0; i < p4.changesets.count; ++i) {
-		p4Changeset *cs = p4.changesets.data + i;
-		if(cs->pending == uics->config.pending) {
-			s_sortChangeset = cs;
-			break;
-		}
-	}
+	s_sortChangeset = p4_find_or_add_changeset_for_view(uics);
 	if(!s_sortChangeset) {
 		return;
 	}
@@ -717,6 +1900,7 @@ p4UIChangeset *p4_find_uichangeset(u32 id)
 
 void p4_mark_uichangeset_for_removal(p4UIChangeset *uics)
 {
+	p4_task_release_view(uics->id);
 	uics->id = 0;
 }
 
@@ -743,6 +1927,7 @@ p4UIChangelist *p4_find_uichangelist(u32 id)
 
 void p4_mark_uichangelist_for_removal(p4UIChangelist *uicl)
 {
+	p4_task_release_view(uicl->id);
 	uicl->id = 0;
 }
 
@@ -764,9 +1949,9 @@ void p4_free_changelist_files(uiChangelistFiles *files)
 {
 	files->selectedCount = 0;
 	for(u32 i = 0; i < files->count; ++i) {
-		for(u32 col = 0; col < BB_ARRAYSIZE(files->data[i].fields.str); ++col) {
-			free(files->data[i].fields.str[col]);
-		}
+		// the other fields are interned
+		free((void *)files->data[i].fields.field.rev);
+		free((void *)files->data[i].fields.field.localPath);
 	}
 	bba_free(*files);
 }
@@ -802,15 +1987,16 @@ static void p4_build_changelist_files_internal(sdict_t *change, sdicts *sds, uiC
 			}
 			if(filename && bba_add(*files, 1)) {
 				uiChangelistFile *file = &bba_last(*files);
-				file->fields.field.filename = _strdup(filename);
+				const char *depotPath = p4_intern_string(p4_intern(depotFile));
+				file->fields.field.filename = depotPath + (filename - depotFile);
 				if(headRev && strcmp(headRev, rev)) {
 					file->fields.field.rev = _strdup(va("%s/%s", rev, headRev));
 				} else {
 					file->fields.field.rev = _strdup(rev);
 				}
-				file->fields.field.action = _strdup(action);
-				file->fields.field.filetype = _strdup(type);
-				file->fields.field.depotPath = _strdup(depotFile);
+				file->fields.field.action = p4_intern_string(p4_intern(action));
+				file->fields.field.filetype = p4_intern_string(p4_intern(type));
+				file->fields.field.depotPath = depotPath;
 				file->fields.field.localPath = _strdup(localPath);
 				file->unresolved = unresolved;
 			}
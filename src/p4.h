@@ -6,6 +6,7 @@
 #include "common.h"
 #include "config.h"
 #include "filter.h"
+#include "p4_changelist_table.h"
 #include "sdict.h"
 
 #if defined(__cplusplus)
@@ -25,6 +26,8 @@ typedef struct tag_p4Changelist {
 	sdicts shelvedFiles;
 	u32 number;
 	u32 parity;
+	p4InternId client; // interned "client" from normal
+	u8 pad[4];
 } p4Changelist;
 
 typedef struct tag_p4Changelists {
@@ -33,16 +36,18 @@ typedef struct tag_p4Changelists {
 	p4Changelist *data;
 } p4Changelists;
 
+// filename points into depotPath, and action, filetype and depotPath are interned - only rev
+// and localPath are owned by the file
 typedef struct tag_uiChangelistFile {
 	union {
-		char *str[6];
+		const char *str[6];
 		struct {
-			char *filename;
-			char *rev;
-			char *action;
-			char *filetype;
-			char *depotPath;
-			char *localPath;
+			const char *filename;
+			const char *rev;
+			const char *action;
+			const char *filetype;
+			const char *depotPath;
+			const char *localPath;
 		} field;
 	} fields;
 	b32 unresolved;
@@ -64,11 +69,18 @@ typedef struct tag_uiChangelistFiles {
 typedef struct tag_p4Changeset {
 	b32 pending;
 	u32 parity;
-	sdicts changelists;
+	sb_t filter; // server-side filter for a submitted view's own result set (see p4_build_changes_filter) - empty for the full lists
+	p4ChangelistTable changelists;
+	p4ChangelistTable newer; // pages of a fetch of newer changes, added to changelists once the last page is in
 	u32 highestReceived;
 	b32 refreshed;
 	b32 updating;
-	u8 pad[4];
+	b32 stale; // showing the cached pending list until a refresh reconciles it
+	u32 lowestReceived; // submitted history is loaded from here to highestReceived - 1 once it is all loaded
+	b32 fetchingHistory;
+	p4ChangelistPatch patch; // the last reconcile that patched rows in place - views that saw the previous
+	u32 patchCount;          // patchCount follow it, others rebuild
+	u32 changeCounter;       // the change counter when newer changes were last requested (see p4_poll_change_counter)
 } p4Changeset;
 
 typedef struct tag_p4Changesets {
@@ -83,9 +95,8 @@ typedef struct tag_p4UIChangesetEntry {
 	b32 selected;
 	b32 described;
 	u32 parity;
-	u8 pad[4];
+	p4InternId client;
 	const char *sortKey;
-	sb_t client;
 	float startY;
 	float height;
 	uiChangelistFiles normalFiles;
@@ -118,12 +129,13 @@ typedef struct tag_p4UIChangeset {
 	p4UIChangesetSortKeys sorted;
 	filterTokens autoFilterTokens;
 	filterTokens manualFilterTokens;
+	sb_t serverFilter; // the part of the filters pushed down to p4 changes, which picks the view's changeset
 	u32 id;
 	u32 lastClickIndex;
 	u32 numValidStartY;
 	u32 lastStartIndex;
 	float lastStartY;
-	u8 pad[4];
+	u32 patchCount;
 } p4UIChangeset;
 
 typedef struct tag_p4UIChangesets {
@@ -142,7 +154,7 @@ typedef enum tag_changesetColumnType {
 typedef struct tag_changesetColumnField {
 	const char *key;
 	changesetColumnType type;
-	u8 pad[4];
+	p4ChangelistColumn column;
 } changesetColumnField;
 
 typedef struct tag_p4UIChangelist {
@@ -169,6 +181,12 @@ typedef struct tag_p4FileLocator
 	u8 pad[4];
 } p4FileLocator;
 
+typedef struct tag_p4ClientIndices {
+	u32 count;
+	u32 allocated;
+	u32 *data;
+} p4ClientIndices;
+
 typedef struct tag_p4 {
 	sb_t exe;
 
@@ -176,8 +194,8 @@ typedef struct tag_p4 {
 	sdict_t set;
 	sdicts allUsers;
 	sdicts allClients;
-	sdicts selfClients;
-	sdicts localClients;
+	p4ClientIndices selfClients;  // indices into allClients
+	p4ClientIndices localClients; // indices into allClients
 	p4Changelists changelists;
 	p4UIChangelists uiChangelists;
 	p4Changesets changesets;
@@ -192,6 +210,7 @@ extern p4_t p4;
 const char *p4_exe(void);
 const char *p4_dir(void);
 const char *p4_clientspec(void);
+p4InternId p4_clientspec_id(void); // ~0u if there is no clientspec
 const char *p4_clientspec_arg(void);
 void p4_set_clientspec(const char *client);
 
@@ -207,7 +226,7 @@ typedef enum tag_p4ChangelistType {
 	kChangelistType_PendingLocal,
 	kChangelistType_Submitted,
 } p4ChangelistType;
-p4ChangelistType p4_get_changelist_type(sdict_t *cl);
+p4ChangelistType p4_get_changelist_type(const p4Changelist *cl);
 
 sdict_t *p4_get_info(void);
 
@@ -216,9 +235,24 @@ sdict_t *p4_get_info(void);
 void p4_info(void);
 
 p4Changeset *p4_find_or_add_changeset(b32 pending);
+// the changeset a view shows - its own result set if it has a server filter
+p4Changeset *p4_find_or_add_changeset_for_view(const p4UIChangeset *uics);
+// Filters the server can apply are compiled into p4 changes arguments, so a narrow submitted view
+// fetches only its own changes instead of filtering the whole history.  filter receives the
+// arguments (empty if there is nothing to push down) and clientFilter the manual filter with the
+// server-only path: tokens removed.  Either can be NULL.
+void p4_build_changes_filter(sb_t *filter, sb_t *clientFilter, const char *user, const char *client, const char *manualFilter);
 void p4_refresh_changeset(p4Changeset *cs);
 void p4_refresh_changelist_no_cache(p4Changeset *cs);
 void p4_request_newer_changes(p4Changeset *cs, u32 blockSize);
+// fetches the next page of submitted history below lowestReceived, unless it is all loaded
+void p4_request_older_changes(p4Changeset *cs);
+
+// returns appdata p4t\<name>.<server>@<user>[.<extension>] - caches are kept per server and user
+sb_t p4_cache_shard_path(const char *name, const char *extension);
+
+// last update time of a change in the pending changeset, or 0 if it isn't pending (or not known yet)
+u32 p4_pending_change_time(u32 change);
 void p4_mark_uichangeset_for_removal(p4UIChangeset *uics);
 
 p4UIChangeset *p4_add_uichangeset(b32 pending);
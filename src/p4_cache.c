@@ -0,0 +1,808 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_cache.h"
+#include "bb.h"
+#include "bb_array.h"
+#include "bb_wrap_stdio.h"
+#include "file_utils.h"
+#include "sb.h"
+#include "str.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+struct tag_p4MappedFile {
+	HANDLE file;
+	HANDLE mapping;
+	const u8 *view;
+	u32 size;
+	volatile LONG refs; // tables borrowing columns and readers decoding segments each hold one
+};
+
+p4MappedFile *p4_mapped_file_open(const char *path)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) {
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || size.QuadPart <= 0 || size.QuadPart > 0xffffffffll) {
+		CloseHandle(file);
+		return NULL;
+	}
+	// copy-on-write, so the table can patch columns in place without touching the file
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if(!mapping) {
+		CloseHandle(file);
+		return NULL;
+	}
+	const u8 *view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	p4MappedFile *mapped = view ? malloc(sizeof(p4MappedFile)) : NULL;
+	if(!mapped) {
+		if(view) {
+			UnmapViewOfFile(view);
+		}
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return NULL;
+	}
+	memset(mapped, 0, sizeof(*mapped));
+	mapped->file = file;
+	mapped->mapping = mapping;
+	mapped->view = view;
+	mapped->size = (u32)size.QuadPart;
+	mapped->refs = 1;
+	return mapped;
+}
+
+p4MappedFile *p4_mapped_file_retain(p4MappedFile *mapped)
+{
+	if(mapped) {
+		InterlockedIncrement(&mapped->refs);
+	}
+	return mapped;
+}
+
+void p4_mapped_file_close(p4MappedFile *mapped)
+{
+	if(mapped && InterlockedDecrement(&mapped->refs) == 0) {
+		UnmapViewOfFile(mapped->view);
+		CloseHandle(mapped->mapping);
+		CloseHandle(mapped->file);
+		free(mapped);
+	}
+}
+
+const u8 *p4_mapped_file_data(const p4MappedFile *mapped)
+{
+	return mapped ? mapped->view : NULL;
+}
+
+u32 p4_mapped_file_size(const p4MappedFile *mapped)
+{
+	return mapped ? mapped->size : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// checksums
+
+static u32 p4_snapshot_checksum(u32 hash, const void *data, u32 size)
+{
+	const u8 *bytes = data;
+	for(u32 i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static u32 p4_snapshot_header_checksum(const p4SnapshotHeader *header)
+{
+	return p4_snapshot_checksum(2166136261u, header, offsetof(p4SnapshotHeader, headerChecksum));
+}
+
+static u32 p4_snapshot_names_checksum(const u8 *data, const p4SnapshotHeader *header)
+{
+	u32 hash = p4_snapshot_checksum(2166136261u, data + header->nameOffsetsOffset, header->numNames * sizeof(u32));
+	return p4_snapshot_checksum(hash, data + header->namesOffset, header->namesSize);
+}
+
+// the caller has checked every desc offset is inside the descriptions, which end in a nul
+static u32 p4_snapshot_segment_checksum(const u8 *data, const p4SnapshotHeader *header, u32 firstRow, u32 count)
+{
+	const u32 columnOffsets[] = { header->changeOffset, header->timeOffset, header->userOffset, header->clientOffset, header->descOffset };
+	u32 hash = 2166136261u;
+	for(u32 i = 0; i < BB_ARRAYSIZE(columnOffsets); ++i) {
+		hash = p4_snapshot_checksum(hash, data + columnOffsets[i] + firstRow * sizeof(u32), count * sizeof(u32));
+	}
+	hash = p4_snapshot_checksum(hash, data + header->statusOffset + firstRow, count);
+	hash = p4_snapshot_checksum(hash, data + header->changeTypeOffset + firstRow, count);
+	const u32 *desc = (const u32 *)(data + header->descOffset);
+	const char *descriptions = (const char *)data + header->descriptionsOffset;
+	for(u32 row = firstRow; row < firstRow + count; ++row) {
+		const char *str = descriptions + desc[row];
+		hash = p4_snapshot_checksum(hash, str, (u32)strlen(str));
+	}
+	return hash;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// writing
+
+typedef struct tag_p4SnapshotName {
+	p4InternId id;
+	u32 index;
+} p4SnapshotName;
+
+// intern id -> snapshot name index, so names are stored once however many rows use them
+typedef struct tag_p4SnapshotNames {
+	p4SnapshotName *buckets;
+	u32 numBuckets;
+	u32 count;
+	u32 allocated;
+	u8 pad[4];
+	p4InternId *ids; // by name index
+} p4SnapshotNames;
+
+static void p4_snapshot_names_reset(p4SnapshotNames *names)
+{
+	free(names->buckets);
+	free(names->ids);
+	memset(names, 0, sizeof(*names));
+}
+
+static void p4_snapshot_names_insert(p4SnapshotName *buckets, u32 numBuckets, p4SnapshotName name)
+{
+	u32 mask = numBuckets - 1;
+	u32 bucket = (name.id * 2654435761u) & mask;
+	while(buckets[bucket].id != ~0u) {
+		bucket = (bucket + 1) & mask;
+	}
+	buckets[bucket] = name;
+}
+
+static b32 p4_snapshot_names_grow(p4SnapshotNames *names)
+{
+	u32 numBuckets = names->numBuckets ? names->numBuckets * 2 : 1024;
+	p4SnapshotName *buckets = malloc(numBuckets * sizeof(p4SnapshotName));
+	p4InternId *ids = realloc(names->ids, (numBuckets / 2) * sizeof(p4InternId));
+	if(!buckets || !ids) {
+		free(buckets);
+		if(ids) {
+			names->ids = ids;
+		}
+		return false;
+	}
+	memset(buckets, 0xff, numBuckets * sizeof(p4SnapshotName));
+	for(u32 i = 0; i < names->count; ++i) {
+		p4SnapshotName name = { ids[i], i };
+		p4_snapshot_names_insert(buckets, numBuckets, name);
+	}
+	free(names->buckets);
+	names->buckets = buckets;
+	names->numBuckets = numBuckets;
+	names->allocated = numBuckets / 2;
+	names->ids = ids;
+	return true;
+}
+
+// returns ~0u if out of memory
+static u32 p4_snapshot_names_add(p4SnapshotNames *names, p4InternId id)
+{
+	if(id == ~0u) {
+		id = kP4InternId_Empty; // failed to intern - ~0u marks empty buckets
+	}
+	if(names->numBuckets) {
+		u32 mask = names->numBuckets - 1;
+		for(u32 bucket = (id * 2654435761u) & mask; names->buckets[bucket].id != ~0u; bucket = (bucket + 1) & mask) {
+			if(names->buckets[bucket].id == id) {
+				return names->buckets[bucket].index;
+			}
+		}
+	}
+	if(names->count >= names->allocated && !p4_snapshot_names_grow(names)) {
+		return ~0u;
+	}
+	p4SnapshotName name = { id, names->count };
+	p4_snapshot_names_insert(names->buckets, names->numBuckets, name);
+	names->ids[names->count++] = id;
+	return name.index;
+}
+
+static u32 p4_snapshot_align(u32 offset)
+{
+	return (offset + 3) & ~3u;
+}
+
+static int p4_snapshot_order_compare(const void *_a, const void *_b)
+{
+	u64 a = *(const u64 *)_a;
+	u64 b = *(const u64 *)_b;
+	return (a < b) ? 1 : (a > b) ? -1 : 0;
+}
+
+// row indices sorted by change number, newest first, so the first segments hold the newest rows
+static u32 *p4_snapshot_build_order(const p4ChangelistTable *table)
+{
+	u32 count = table->count;
+	u64 *keys = malloc(BB_MAX(count, 1u) * sizeof(u64));
+	u32 *order = malloc(BB_MAX(count, 1u) * sizeof(u32));
+	if(!keys || !order) {
+		free(keys);
+		free(order);
+		return NULL;
+	}
+	for(u32 row = 0; row < count; ++row) {
+		keys[row] = ((u64)table->change[row] << 32) | row;
+	}
+	qsort(keys, count, sizeof(u64), p4_snapshot_order_compare);
+	for(u32 i = 0; i < count; ++i) {
+		order[i] = (u32)keys[i];
+	}
+	free(keys);
+	return order;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// snapshot versions
+
+// Readers keep the snapshot mapped, and Windows won't replace or delete a file with a mapped view,
+// so the snapshot path names a small pointer file holding the version of the newest snapshot, which
+// lives beside it as <path>.<version>.  Each save writes a new version and swaps the pointer.
+
+static b32 p4_cache_replace_file(const char *path, void *buffer, u32 size)
+{
+	b32 wrote = false;
+	sb_t tempPath = { 0 };
+	sb_va(&tempPath, "%s.tmp", path);
+	fileData_t fd = { 0 };
+	fd.buffer = buffer;
+	fd.bufferSize = size;
+	if(fileData_write(sb_get(&tempPath), NULL, fd)) {
+		wrote = MoveFileExA(sb_get(&tempPath), path, MOVEFILE_REPLACE_EXISTING) != 0;
+		if(!wrote) {
+			BB_ERROR("p4::cache", "failed to replace %s - error %u", path, (u32)GetLastError());
+			file_delete(sb_get(&tempPath));
+		}
+	}
+	sb_reset(&tempPath);
+	return wrote;
+}
+
+// 0 if there is no pointer yet, or the path still holds a snapshot from before versions
+static u32 p4_snapshot_current_version(const char *path, b32 *unversioned)
+{
+	u32 version = 0;
+	*unversioned = false;
+	fileData_t fd = fileData_read(path);
+	if(fd.buffer) {
+		const char *text = fd.buffer;
+		if(fd.bufferSize >= sizeof(u32) && *(const u32 *)fd.buffer == kP4Snapshot_Magic) {
+			*unversioned = true;
+		} else {
+			for(u32 i = 0; i < fd.bufferSize && text[i] >= '0' && text[i] <= '9'; ++i) {
+				version = version * 10 + (u32)(text[i] - '0');
+			}
+		}
+		fileData_reset(&fd);
+	}
+	return version;
+}
+
+static b32 p4_snapshot_version_suffix(const char *suffix, u32 *version)
+{
+	*version = 0;
+	if(!*suffix) {
+		return false;
+	}
+	for(; *suffix; ++suffix) {
+		if(*suffix < '0' || *suffix > '9') {
+			return false;
+		}
+		*version = *version * 10 + (u32)(*suffix - '0');
+	}
+	return true;
+}
+
+// A version still mapped by a reader fails to delete, and is tried again after the next save.
+static void p4_snapshot_delete_old_versions(const char *path, u32 current)
+{
+	const char *name = strrchr(path, '\\');
+	size_t dirLen = name ? (size_t)(name - path) + 1 : 0;
+	name = name ? name + 1 : path;
+	size_t nameLen = strlen(name);
+	sb_t pattern = { 0 };
+	sb_va(&pattern, "%s.*", path);
+	WIN32_FIND_DATAA find;
+	HANDLE handle = FindFirstFileA(sb_get(&pattern), &find);
+	sb_reset(&pattern);
+	if(handle != INVALID_HANDLE_VALUE) {
+		do {
+			u32 version;
+			if(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY || _strnicmp(find.cFileName, name, nameLen) || find.cFileName[nameLen] != '.' ||
+			   !p4_snapshot_version_suffix(find.cFileName + nameLen + 1, &version) || version == current) {
+				continue;
+			}
+			sb_t oldPath = { 0 };
+			sb_va(&oldPath, "%.*s%s", (int)dirLen, path, find.cFileName);
+			if(!DeleteFileA(sb_get(&oldPath))) {
+				BB_LOG("p4::cache", "kept %s - error %u", sb_get(&oldPath), (u32)GetLastError());
+			}
+			sb_reset(&oldPath);
+		} while(FindNextFileA(handle, &find));
+		FindClose(handle);
+	}
+}
+
+static b32 p4_snapshot_publish(const char *path, void *buffer, u32 size)
+{
+	b32 unversioned;
+	u32 version = p4_snapshot_current_version(path, &unversioned) + 1;
+	sb_t versionPath = { 0 };
+	sb_va(&versionPath, "%s.%u", path, version);
+	b32 wrote = p4_cache_replace_file(sb_get(&versionPath), buffer, size);
+	sb_reset(&versionPath);
+	if(wrote) {
+		sb_t pointer = { 0 };
+		sb_va(&pointer, "%u\n", version);
+		wrote = p4_cache_replace_file(path, pointer.data, sb_len(&pointer));
+		sb_reset(&pointer);
+	}
+	if(wrote) {
+		p4_snapshot_delete_old_versions(path, version);
+	}
+	return wrote;
+}
+
+static p4MappedFile *p4_snapshot_map(const char *path)
+{
+	// a save can delete the version between reading the pointer and mapping it, so look again once
+	for(u32 attempt = 0; attempt < 2; ++attempt) {
+		b32 unversioned;
+		u32 version = p4_snapshot_current_version(path, &unversioned);
+		if(unversioned) {
+			return p4_mapped_file_open(path);
+		}
+		if(!version) {
+			return NULL;
+		}
+		sb_t versionPath = { 0 };
+		sb_va(&versionPath, "%s.%u", path, version);
+		p4MappedFile *mapped = p4_mapped_file_open(sb_get(&versionPath));
+		sb_reset(&versionPath);
+		if(mapped) {
+			return mapped;
+		}
+	}
+	return NULL;
+}
+
+b32 p4_cache_write_snapshot(const char *path, const p4ChangelistTable *table, u32 minChange, u32 maxChange)
+{
+	u32 count = table->count;
+	p4SnapshotNames names = { 0 };
+	u32 *order = p4_snapshot_build_order(table);
+	u32 *user = malloc(BB_MAX(count, 1u) * sizeof(u32));
+	u32 *client = malloc(BB_MAX(count, 1u) * sizeof(u32));
+	b32 named = order && user && client;
+	for(u32 i = 0; named && i < count; ++i) {
+		user[i] = p4_snapshot_names_add(&names, table->user[order[i]]);
+		client[i] = p4_snapshot_names_add(&names, table->client[order[i]]);
+		named = user[i] != ~0u && client[i] != ~0u;
+	}
+	if(!named) {
+		free(order);
+		free(user);
+		free(client);
+		p4_snapshot_names_reset(&names);
+		return false;
+	}
+	u32 namesSize = 0;
+	for(u32 i = 0; i < names.count; ++i) {
+		namesSize += (u32)strlen(p4_intern_string(names.ids[i])) + 1;
+	}
+
+	p4SnapshotHeader header = { 0 };
+	header.magic = kP4Snapshot_Magic;
+	header.version = kP4Snapshot_Version;
+	header.headerSize = sizeof(header);
+	header.count = count;
+	header.maxChange = maxChange;
+	header.segmentRows = kP4Snapshot_SegmentRows;
+	header.numNames = names.count;
+	u32 numSegments = (count + kP4Snapshot_SegmentRows - 1) / kP4Snapshot_SegmentRows;
+	header.segmentsOffset = sizeof(header);
+	header.nameOffsetsOffset = header.segmentsOffset + numSegments * sizeof(p4SnapshotSegment);
+	header.changeOffset = header.nameOffsetsOffset + names.count * sizeof(u32);
+	header.timeOffset = header.changeOffset + count * sizeof(u32);
+	header.userOffset = header.timeOffset + count * sizeof(u32);
+	header.clientOffset = header.userOffset + count * sizeof(u32);
+	header.descOffset = header.clientOffset + count * sizeof(u32);
+	header.statusOffset = header.descOffset + count * sizeof(u32);
+	header.changeTypeOffset = p4_snapshot_align(header.statusOffset + count);
+	header.namesOffset = p4_snapshot_align(header.changeTypeOffset + count);
+	header.namesSize = namesSize;
+	header.descriptionsOffset = p4_snapshot_align(header.namesOffset + namesSize);
+	header.descriptionsSize = table->descriptions.count;
+	header.fileSize = header.descriptionsOffset + header.descriptionsSize;
+
+	b32 wrote = false;
+	u8 *buffer = malloc(header.fileSize);
+	if(buffer) {
+		memset(buffer, 0, header.fileSize);
+		u32 *nameOffsets = (u32 *)(buffer + header.nameOffsetsOffset);
+		char *nameData = (char *)buffer + header.namesOffset;
+		u32 nameOffset = 0;
+		for(u32 i = 0; i < names.count; ++i) {
+			const char *name = p4_intern_string(names.ids[i]);
+			u32 len = (u32)strlen(name) + 1;
+			nameOffsets[i] = nameOffset;
+			memcpy(nameData + nameOffset, name, len);
+			nameOffset += len;
+		}
+		u32 *change = (u32 *)(buffer + header.changeOffset);
+		u32 *time = (u32 *)(buffer + header.timeOffset);
+		u32 *desc = (u32 *)(buffer + header.descOffset);
+		u8 *status = buffer + header.statusOffset;
+		u8 *changeType = buffer + header.changeTypeOffset;
+		for(u32 i = 0; i < count; ++i) {
+			u32 row = order[i];
+			change[i] = table->change[row];
+			time[i] = table->time[row];
+			desc[i] = table->desc[row];
+			status[i] = table->status[row];
+			changeType[i] = table->changeType[row];
+		}
+		if(count) {
+			memcpy(buffer + header.userOffset, user, count * sizeof(u32));
+			memcpy(buffer + header.clientOffset, client, count * sizeof(u32));
+		}
+		if(header.descriptionsSize) {
+			memcpy(buffer + header.descriptionsOffset, table->descriptions.data, header.descriptionsSize);
+		}
+		p4SnapshotSegment *segments = (p4SnapshotSegment *)(buffer + header.segmentsOffset);
+		for(u32 segment = 0; segment < numSegments; ++segment) {
+			u32 firstRow = segment * kP4Snapshot_SegmentRows;
+			u32 segmentCount = BB_MIN((u32)kP4Snapshot_SegmentRows, count - firstRow);
+			u32 oldest = change[firstRow + segmentCount - 1];
+			segments[segment].checksum = p4_snapshot_segment_checksum(buffer, &header, firstRow, segmentCount);
+			segments[segment].highChange = segment ? (segments[segment - 1].lowChange ? segments[segment - 1].lowChange - 1 : 0) : maxChange;
+			segments[segment].lowChange = (segment + 1 < numSegments) ? oldest : BB_MIN(oldest, minChange);
+		}
+		header.namesChecksum = p4_snapshot_names_checksum(buffer, &header);
+		header.headerChecksum = p4_snapshot_header_checksum(&header);
+		memcpy(buffer, &header, sizeof(header));
+
+		wrote = p4_snapshot_publish(path, buffer, header.fileSize);
+		free(buffer);
+	}
+	free(order);
+	free(user);
+	free(client);
+	p4_snapshot_names_reset(&names);
+	return wrote;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// reading
+
+static b32 p4_snapshot_range_valid(const p4SnapshotHeader *header, u32 fileSize, u32 offset, u32 size, u32 alignment)
+{
+	return (offset % alignment) == 0 && offset >= header->headerSize && offset <= fileSize && size <= fileSize - offset;
+}
+
+// older versions end at segmentRows
+static u32 p4_snapshot_header_size(u32 version)
+{
+	return (version >= kP4Snapshot_ChecksumVersion) ? sizeof(p4SnapshotHeader) : offsetof(p4SnapshotHeader, segmentsOffset);
+}
+
+// A truncated snapshot (fileSize short of the header's) is accepted if it has segments to refetch
+// and is only missing descriptions, which come last - the rows whose descriptions are gone are
+// treated as damaged when they are decoded.  Everything else has to be inside the file.
+static b32 p4_snapshot_header_valid(const p4SnapshotHeader *header, u32 fileSize)
+{
+	if(fileSize < offsetof(p4SnapshotHeader, segmentsOffset) || header->magic != kP4Snapshot_Magic ||
+	   header->version < kP4Snapshot_MinVersion || header->version > kP4Snapshot_Version ||
+	   header->headerSize != p4_snapshot_header_size(header->version) || header->count > fileSize / 4 || header->numNames > fileSize / 4) {
+		return false;
+	}
+	if(header->fileSize != fileSize && (header->fileSize < fileSize || header->version < kP4Snapshot_ChecksumVersion)) {
+		return false;
+	}
+	u32 columnSize = header->count * sizeof(u32);
+	if(header->version >= kP4Snapshot_ChecksumVersion) {
+		if(!header->segmentRows) {
+			return false;
+		}
+		u32 numSegments = (header->count + header->segmentRows - 1) / header->segmentRows;
+		if(!p4_snapshot_range_valid(header, fileSize, header->segmentsOffset, numSegments * sizeof(p4SnapshotSegment), 4)) {
+			return false;
+		}
+	}
+	return p4_snapshot_range_valid(header, fileSize, header->nameOffsetsOffset, header->numNames * sizeof(u32), 4) &&
+	       p4_snapshot_range_valid(header, fileSize, header->changeOffset, columnSize, 4) &&
+	       p4_snapshot_range_valid(header, fileSize, header->timeOffset, columnSize, 4) &&
+	       p4_snapshot_range_valid(header, fileSize, header->userOffset, columnSize, 4) &&
+	       p4_snapshot_range_valid(header, fileSize, header->clientOffset, columnSize, 4) &&
+	       p4_snapshot_range_valid(header, fileSize, header->descOffset, columnSize, 4) &&
+	       p4_snapshot_range_valid(header, fileSize, header->statusOffset, header->count, 1) &&
+	       p4_snapshot_range_valid(header, fileSize, header->changeTypeOffset, header->count, 1) &&
+	       p4_snapshot_range_valid(header, fileSize, header->namesOffset, header->namesSize, 1) &&
+	       p4_snapshot_range_valid(header, fileSize, header->descriptionsOffset, 0, 1) &&
+	       p4_snapshot_range_valid(header, header->fileSize, header->descriptionsOffset, header->descriptionsSize, 1);
+}
+
+b32 p4_snapshot_reader_open(p4SnapshotReader *reader, const char *path)
+{
+	memset(reader, 0, sizeof(*reader));
+	p4MappedFile *mapped = p4_snapshot_map(path);
+	if(!mapped) {
+		return false;
+	}
+	const u8 *data = mapped->view;
+	const p4SnapshotHeader *header = (const p4SnapshotHeader *)data;
+	if(!p4_snapshot_header_valid(header, mapped->size)) {
+		BB_ERROR("p4::cache", "snapshot %s is invalid or from another version", path);
+		p4_mapped_file_close(mapped);
+		return false;
+	}
+	const char *nameData = (const char *)data + header->namesOffset;
+	const u32 *nameOffsets = (const u32 *)(data + header->nameOffsetsOffset);
+	const char *descriptions = (const char *)data + header->descriptionsOffset;
+	u32 descriptionsSize = BB_MIN(header->descriptionsSize, mapped->size - header->descriptionsOffset);
+	b32 truncated = descriptionsSize < header->descriptionsSize;
+	const char *emptyDesc = descriptionsSize ? memchr(descriptions, '\0', descriptionsSize) : NULL;
+	if((header->namesSize && nameData[header->namesSize - 1]) || (!truncated && descriptionsSize && descriptions[descriptionsSize - 1]) ||
+	   (header->count && !emptyDesc)) {
+		BB_ERROR("p4::cache", "snapshot %s has unterminated strings", path);
+		p4_mapped_file_close(mapped);
+		return false;
+	}
+	if(truncated) {
+		BB_ERROR("p4::cache", "snapshot %s is truncated - %u of %u bytes of descriptions", path, descriptionsSize, header->descriptionsSize);
+	}
+
+	// snapshot name indices -> intern ids.  There are few names, so this is cheap next to the rows.
+	p4InternId *names = malloc(BB_MAX(header->numNames, 1u) * sizeof(p4InternId));
+	b32 valid = names != NULL;
+	for(u32 i = 0; valid && i < header->numNames; ++i) {
+		valid = nameOffsets[i] < header->namesSize;
+		names[i] = valid ? p4_intern(nameData + nameOffsets[i]) : kP4InternId_Empty;
+	}
+	if(!valid) {
+		BB_ERROR("p4::cache", "snapshot %s has out of range names", path);
+		free(names);
+		p4_mapped_file_close(mapped);
+		return false;
+	}
+	reader->mapped = mapped;
+	reader->header = header;
+	reader->names = names;
+	reader->descriptionsSize = descriptionsSize;
+	reader->emptyDesc = emptyDesc ? (u32)(emptyDesc - descriptions) : 0;
+	reader->segmentRows = header->segmentRows ? header->segmentRows : kP4Snapshot_SegmentRows;
+	reader->numSegments = (header->count + reader->segmentRows - 1) / reader->segmentRows;
+	if(header->version >= kP4Snapshot_ChecksumVersion) {
+		reader->segments = (const p4SnapshotSegment *)(data + header->segmentsOffset);
+	}
+	return true;
+}
+
+void p4_snapshot_reader_reset(p4SnapshotReader *reader)
+{
+	p4_mapped_file_close(reader->mapped);
+	free(reader->names);
+	memset(reader, 0, sizeof(*reader));
+}
+
+u32 p4_snapshot_reader_min_change(const p4SnapshotReader *reader)
+{
+	return (reader->segments && reader->numSegments) ? reader->segments[reader->numSegments - 1].lowChange : 1;
+}
+
+u32 p4_snapshot_reader_segment_count(const p4SnapshotReader *reader, u32 segment)
+{
+	u32 firstRow = segment * reader->segmentRows;
+	return (segment < reader->numSegments) ? BB_MIN(reader->segmentRows, reader->header->count - firstRow) : 0;
+}
+
+b32 p4_snapshot_reader_decode(const p4SnapshotReader *reader, u32 segment, p4InternId *user, p4InternId *client)
+{
+	const p4SnapshotHeader *header = reader->header;
+	u8 *data = (u8 *)reader->mapped->view; // copy-on-write
+	const u32 *userIndices = (const u32 *)(data + header->userOffset);
+	const u32 *clientIndices = (const u32 *)(data + header->clientOffset);
+	u32 *desc = (u32 *)(data + header->descOffset);
+	u8 *status = data + header->statusOffset;
+	u8 *changeType = data + header->changeTypeOffset;
+	const char *descriptions = (const char *)data + header->descriptionsOffset;
+	b32 truncated = reader->descriptionsSize < header->descriptionsSize;
+	b32 valid = true;
+	u32 firstRow = segment * reader->segmentRows;
+	u32 count = p4_snapshot_reader_segment_count(reader, segment);
+	for(u32 i = 0; i < count; ++i) {
+		u32 row = firstRow + i;
+		if(userIndices[row] >= header->numNames || clientIndices[row] >= header->numNames || desc[row] >= reader->descriptionsSize ||
+		   (truncated && !memchr(descriptions + desc[row], '\0', reader->descriptionsSize - desc[row])) ||
+		   status[row] >= kP4ChangelistStatus_Count || changeType[row] >= kP4ChangeType_Count) {
+			// blanked so the row is safe to show and checksum until the segment is refetched
+			user[i] = kP4InternId_Empty;
+			client[i] = kP4InternId_Empty;
+			desc[row] = reader->emptyDesc;
+			status[row] = 0;
+			changeType[row] = 0;
+			valid = false;
+			continue;
+		}
+		user[i] = reader->names[userIndices[row]];
+		client[i] = reader->names[clientIndices[row]];
+	}
+	return valid;
+}
+
+b32 p4_snapshot_reader_verify_header(const p4SnapshotReader *reader)
+{
+	const p4SnapshotHeader *header = reader->header;
+	if(!reader->segments) {
+		return true;
+	}
+	return header->headerChecksum == p4_snapshot_header_checksum(header) &&
+	       header->namesChecksum == p4_snapshot_names_checksum(reader->mapped->view, header);
+}
+
+b32 p4_snapshot_reader_verify(const p4SnapshotReader *reader, u32 segment)
+{
+	if(!reader->segments || segment >= reader->numSegments) {
+		return true;
+	}
+	const p4SnapshotHeader *header = reader->header;
+	const u8 *data = reader->mapped->view;
+	const p4SnapshotSegment *entry = reader->segments + segment;
+	u32 highChange = header->maxChange;
+	if(segment) {
+		u32 previousLow = reader->segments[segment - 1].lowChange;
+		highChange = previousLow ? previousLow - 1 : 0;
+	}
+	if(entry->highChange != highChange || entry->lowChange > entry->highChange) {
+		return false;
+	}
+
+	const u32 *change = (const u32 *)(data + header->changeOffset);
+	const u32 *desc = (const u32 *)(data + header->descOffset);
+	u32 firstRow = segment * reader->segmentRows;
+	u32 count = p4_snapshot_reader_segment_count(reader, segment);
+	u32 previous = entry->highChange;
+	for(u32 row = firstRow; row < firstRow + count; ++row) {
+		if(change[row] > previous || change[row] < entry->lowChange || desc[row] >= reader->descriptionsSize) {
+			return false;
+		}
+		previous = change[row];
+	}
+	return entry->checksum == p4_snapshot_segment_checksum(data, header, firstRow, count);
+}
+
+b32 p4_snapshot_reader_borrow(const p4SnapshotReader *reader, p4ChangelistTable *table)
+{
+	p4_changelist_table_reset(table);
+	const p4SnapshotHeader *header = reader->header;
+	const u8 *data = reader->mapped->view;
+	u32 rows = BB_MAX(header->count, 1u);
+	table->user = malloc(rows * sizeof(p4InternId));
+	table->client = malloc(rows * sizeof(p4InternId));
+	if(!table->user || !table->client) {
+		p4_changelist_table_reset(table);
+		return false;
+	}
+	// the rest of the columns are used in place until the table is appended to
+	table->count = 0;
+	table->allocated = header->count;
+	table->change = (u32 *)(data + header->changeOffset);
+	table->time = (u32 *)(data + header->timeOffset);
+	table->desc = (u32 *)(data + header->descOffset);
+	table->status = (u8 *)(data + header->statusOffset);
+	table->changeType = (u8 *)(data + header->changeTypeOffset);
+	table->descriptions.data = (char *)data + header->descriptionsOffset;
+	table->descriptions.count = reader->descriptionsSize;
+	table->descriptions.allocated = reader->descriptionsSize;
+	table->mapped = p4_mapped_file_retain(reader->mapped);
+	return true;
+}
+
+b32 p4_cache_open_snapshot(const char *path, p4ChangelistTable *table, u32 *maxChange)
+{
+	p4_changelist_table_reset(table);
+	p4SnapshotReader reader;
+	if(!p4_snapshot_reader_open(&reader, path)) {
+		return false;
+	}
+	b32 valid = p4_snapshot_reader_borrow(&reader, table);
+	for(u32 segment = 0; valid && segment < reader.numSegments; ++segment) {
+		u32 firstRow = segment * reader.segmentRows;
+		valid = p4_snapshot_reader_decode(&reader, segment, table->user + firstRow, table->client + firstRow);
+	}
+	if(valid) {
+		table->count = reader.header->count;
+		*maxChange = reader.header->maxChange;
+	} else {
+		BB_ERROR("p4::cache", "snapshot %s has out of range columns", path);
+		p4_changelist_table_reset(table);
+	}
+	p4_snapshot_reader_reset(&reader);
+	return valid;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// delta log
+
+b32 p4_cache_append_log(const char *path, const p4ChangelistTable *table, u32 afterChange, u32 *logSize)
+{
+	pyWriter writer = { 0 };
+	if(!p4_changelist_table_write(table, afterChange, &writer)) {
+		bba_free(writer);
+		return false;
+	}
+	if(!writer.count) {
+		return true;
+	}
+	b32 wrote = false;
+	FILE *fp = fopen(path, "ab");
+	if(fp) {
+		wrote = fwrite(writer.data, 1, writer.count, fp) == writer.count;
+		long size = ftell(fp);
+		wrote = (fclose(fp) == 0) && wrote;
+		*logSize = size > 0 ? (u32)size : 0;
+	}
+	bba_free(writer);
+	return wrote;
+}
+
+b32 p4_cache_read_log(const char *path, p4Records *records, u32 *logSize)
+{
+	*logSize = 0;
+	fileData_t fd = fileData_read(path);
+	if(!fd.buffer) {
+		return true;
+	}
+	u32 consumed = 0;
+	b32 valid = p4_records_parse(records, fd.buffer, fd.bufferSize, &consumed) && consumed == fd.bufferSize;
+	if(!valid) {
+		BB_ERROR("p4::cache", "log %s is truncated or invalid - using %u records (%u of %u bytes)", path, records->count, consumed, fd.bufferSize);
+	}
+	*logSize = fd.bufferSize;
+	fileData_reset(&fd);
+	return valid;
+}
+
+void p4_cache_apply_log(p4ChangelistTable *table, const p4Records *records, u32 *maxChange)
+{
+	u32 highest = *maxChange;
+	for(u32 i = 0; i < records->count; ++i) {
+		u32 change = strtou32(p4_record_find_safe(records, i, "change"));
+		if(change > *maxChange && p4_changelist_table_add_record(table, records, i) != ~0u) {
+			highest = BB_MAX(highest, change);
+		}
+	}
+	*maxChange = highest;
+}
+
+b32 p4_cache_read_legacy(const char *path, p4ChangelistTable *table, u32 *maxChange)
+{
+	fileData_t fd = fileData_read(path);
+	if(!fd.buffer) {
+		return false;
+	}
+	p4Records records = { 0 };
+	u32 consumed = 0;
+	if(!p4_records_parse(&records, fd.buffer, fd.bufferSize, &consumed) || consumed != fd.bufferSize) {
+		BB_ERROR("p4::cache", "cached changelists are truncated or invalid - using %u records (%u of %u bytes)", records.count, consumed, fd.bufferSize);
+	}
+	fileData_reset(&fd);
+	p4_changelist_table_add_records(table, &records);
+	p4_records_reset(&records);
+	*maxChange = 0;
+	for(u32 i = 0; i < table->count; ++i) {
+		*maxChange = BB_MAX(*maxChange, table->change[i]);
+	}
+	return true;
+}
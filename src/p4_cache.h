@@ -0,0 +1,139 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "p4_changelist_table.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// The submitted changelist cache is a versioned binary snapshot of a p4ChangelistTable: a header,
+// a name table, fixed-width columns and the description blob.  Loading maps the file and uses the
+// columns and descriptions in place, so opening a long history doesn't parse or copy it.  Only the
+// user and client columns are rewritten, from snapshot name indices to process-wide intern ids.
+// Rows are stored newest first, in segments of segmentRows rows that can be decoded independently,
+// so several threads can decode a long history while the newest rows are already on screen.
+// Each segment records a checksum of its rows and the range of change numbers it covers.  The
+// ranges partition minChange..maxChange, so a damaged segment can be refetched from the server by range
+// without throwing away the rest of the history.
+
+enum {
+	kP4Snapshot_Magic = 0x53543450, // "P4TS"
+	kP4Snapshot_MinVersion = 1,     // same layout, unsorted and without segmentRows
+	kP4Snapshot_ChecksumVersion = 3, // adds segments and checksums
+	kP4Snapshot_Version = 3,
+	kP4Snapshot_SegmentRows = 65536,
+};
+
+typedef struct tag_p4SnapshotHeader {
+	u32 magic;
+	u32 version;
+	u32 headerSize;
+	u32 fileSize;
+	u32 count;
+	u32 maxChange;
+	u32 numNames;
+	u32 nameOffsetsOffset; // u32[numNames] offsets into the names blob
+	u32 namesOffset;       // nul-terminated names
+	u32 namesSize;
+	u32 changeOffset;     // u32[count]
+	u32 timeOffset;       // u32[count]
+	u32 userOffset;       // u32[count] name indices
+	u32 clientOffset;     // u32[count] name indices
+	u32 descOffset;       // u32[count] offsets into the descriptions blob
+	u32 statusOffset;     // u8[count]
+	u32 changeTypeOffset; // u8[count]
+	u32 descriptionsOffset;
+	u32 descriptionsSize;
+	u32 segmentRows;
+	u32 segmentsOffset; // p4SnapshotSegment[numSegments] (version 3)
+	u32 namesChecksum;  // name offsets and names (version 3)
+	u32 headerChecksum; // the header up to here (version 3)
+} p4SnapshotHeader;
+
+typedef struct tag_p4SnapshotSegment {
+	u32 checksum;   // the segment's columns and descriptions
+	u32 lowChange;  // covered change numbers, inclusive - each segment starts just below the one
+	u32 highChange; // before it, the first at maxChange and the last at the snapshot's minChange
+} p4SnapshotSegment;
+
+typedef struct tag_p4MappedFile p4MappedFile;
+
+// mapped files are reference counted - close releases the caller's reference
+p4MappedFile *p4_mapped_file_open(const char *path);
+p4MappedFile *p4_mapped_file_retain(p4MappedFile *mapped);
+void p4_mapped_file_close(p4MappedFile *mapped);
+const u8 *p4_mapped_file_data(const p4MappedFile *mapped);
+u32 p4_mapped_file_size(const p4MappedFile *mapped);
+
+// writes to a temp file and swaps it in, so a reader never sees a partial snapshot.  The table
+// holds every change from minChange to maxChange - 1 if it goes back to the start of history.
+// Readers keep snapshots mapped, so path is a pointer to the newest version (<path>.<version>)
+// rather than the snapshot itself - older versions are deleted once nothing maps them.
+b32 p4_cache_write_snapshot(const char *path, const p4ChangelistTable *table, u32 minChange, u32 maxChange);
+
+// A snapshot being decoded a segment at a time.  Decoding only reads the mapping and names, so
+// segments can be decoded on several threads at once.
+typedef struct tag_p4SnapshotReader {
+	p4MappedFile *mapped;
+	const p4SnapshotHeader *header;
+	p4InternId *names;                // snapshot name index -> intern id
+	const p4SnapshotSegment *segments; // NULL before version 3
+	u32 numSegments;
+	u32 segmentRows;
+	u32 descriptionsSize; // in the file - short of the header's if the file was truncated
+	u32 emptyDesc;        // an empty description, for blanking damaged rows
+} p4SnapshotReader;
+
+// maps the snapshot and interns its names.  Returns false if the file is missing, from a different
+// version, or truncated anywhere but its descriptions.
+b32 p4_snapshot_reader_open(p4SnapshotReader *reader, const char *path);
+void p4_snapshot_reader_reset(p4SnapshotReader *reader);
+// the lowest change covered - snapshots from before version 3 always hold the whole history
+u32 p4_snapshot_reader_min_change(const p4SnapshotReader *reader);
+u32 p4_snapshot_reader_segment_count(const p4SnapshotReader *reader, u32 segment);
+
+// validates a segment's rows and fills user and client (one entry per row) with intern ids.  Rows
+// with out of range columns, or descriptions past the end of a truncated file, are blanked in the
+// copy-on-write mapping and false is returned, so the segment can be refetched.
+b32 p4_snapshot_reader_decode(const p4SnapshotReader *reader, u32 segment, p4InternId *user, p4InternId *client);
+
+// Checksums are only compared when asked, so loading doesn't pay for reading every byte.  Both
+// pass for snapshots from before version 3, which have nothing to check.
+b32 p4_snapshot_reader_verify_header(const p4SnapshotReader *reader);
+// also checks the segment's rows are in order and inside its covered range
+b32 p4_snapshot_reader_verify(const p4SnapshotReader *reader, u32 segment);
+
+// points table (which is reset first) at the mapped columns, with room for every row but none
+// visible.  The caller copies decoded segments into user and client and raises count to match.
+b32 p4_snapshot_reader_borrow(const p4SnapshotReader *reader, p4ChangelistTable *table);
+
+// maps and decodes the whole snapshot into table (which is reset first)
+b32 p4_cache_open_snapshot(const char *path, p4ChangelistTable *table, u32 *maxChange);
+
+// Changelists received after the snapshot was written are appended to a log of p4 -G changes
+// records rather than rewriting the snapshot.  Once the log grows past kP4Cache_CompactLogSize it
+// is folded into a new snapshot in the background.  Loading skips logged rows the snapshot already
+// covers, so a log that outlives its compaction is harmless.
+enum {
+	kP4Cache_CompactLogSize = 2 * 1024 * 1024,
+};
+
+// appends rows newer than afterChange - logSize receives the size of the log afterwards
+b32 p4_cache_append_log(const char *path, const p4ChangelistTable *table, u32 afterChange, u32 *logSize);
+
+// reads the log's records.  A missing log is empty.  Returns false if the log has a damaged tail -
+// the records before it are still read.
+b32 p4_cache_read_log(const char *path, p4Records *records, u32 *logSize);
+
+// adds logged rows newer than maxChange and raises maxChange to match
+void p4_cache_apply_log(p4ChangelistTable *table, const p4Records *records, u32 *maxChange);
+
+// reads the pre-snapshot cache (p4 -G changes marshal output) - used once to migrate
+b32 p4_cache_read_legacy(const char *path, p4ChangelistTable *table, u32 *maxChange);
+
+#if defined(__cplusplus)
+}
+#endif
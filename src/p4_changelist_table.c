@@ -0,0 +1,439 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_changelist_table.h"
+#include "bb_array.h"
+#include "p4_cache.h"
+#include "str.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *s_changelistStatusNames[] = {
+	"submitted",
+	"pending",
+	"shelved",
+};
+BB_CTASSERT(BB_ARRAYSIZE(s_changelistStatusNames) == kP4ChangelistStatus_Count);
+
+static const char *s_changeTypeNames[] = {
+	"public",
+	"restricted",
+};
+BB_CTASSERT(BB_ARRAYSIZE(s_changeTypeNames) == kP4ChangeType_Count);
+
+void p4_changelist_table_reset(p4ChangelistTable *table)
+{
+	free(table->user);
+	free(table->client);
+	if(table->mapped) {
+		p4_mapped_file_close(table->mapped);
+	} else {
+		free(table->change);
+		free(table->time);
+		free(table->desc);
+		free(table->status);
+		free(table->changeType);
+		bba_free(table->descriptions);
+	}
+	memset(table, 0, sizeof(*table));
+}
+
+void p4_changelist_table_move(p4ChangelistTable *target, p4ChangelistTable *src)
+{
+	p4_changelist_table_reset(target);
+	*target = *src;
+	memset(src, 0, sizeof(*src));
+}
+
+static b32 p4_changelist_table_grow_column(void **column, u32 allocated, u32 elementSize)
+{
+	void *data = realloc(*column, (size_t)allocated * elementSize);
+	if(!data) {
+		return false;
+	}
+	*column = data;
+	return true;
+}
+
+static void *p4_changelist_table_copy_column(const void *column, u32 size)
+{
+	void *data = malloc(BB_MAX(size, 1u));
+	if(data && size) {
+		memcpy(data, column, size);
+	}
+	return data;
+}
+
+// copies the columns that point into a snapshot, so they can grow
+static b32 p4_changelist_table_own(p4ChangelistTable *table)
+{
+	if(!table->mapped) {
+		return true;
+	}
+	u32 count = table->count;
+	u32 *change = p4_changelist_table_copy_column(table->change, count * sizeof(u32));
+	u32 *time = p4_changelist_table_copy_column(table->time, count * sizeof(u32));
+	u32 *desc = p4_changelist_table_copy_column(table->desc, count * sizeof(u32));
+	u8 *status = p4_changelist_table_copy_column(table->status, count);
+	u8 *changeType = p4_changelist_table_copy_column(table->changeType, count);
+	p4RecordStrings descriptions = { 0 };
+	if(table->descriptions.count) {
+		bba_add_array(descriptions, table->descriptions.data, table->descriptions.count);
+	}
+	if(!change || !time || !desc || !status || !changeType || (table->descriptions.count && !descriptions.data)) {
+		free(change);
+		free(time);
+		free(desc);
+		free(status);
+		free(changeType);
+		bba_free(descriptions);
+		return false;
+	}
+	p4_mapped_file_close(table->mapped);
+	table->mapped = NULL;
+	table->allocated = count; // the copies only hold the rows in use, whatever the snapshot had
+	table->change = change;
+	table->time = time;
+	table->desc = desc;
+	table->status = status;
+	table->changeType = changeType;
+	table->descriptions = descriptions;
+	return true;
+}
+
+b32 p4_changelist_table_copy(p4ChangelistTable *target, const p4ChangelistTable *src)
+{
+	p4_changelist_table_reset(target);
+	u32 count = src->count;
+	target->change = p4_changelist_table_copy_column(src->change, count * sizeof(u32));
+	target->time = p4_changelist_table_copy_column(src->time, count * sizeof(u32));
+	target->user = p4_changelist_table_copy_column(src->user, count * sizeof(p4InternId));
+	target->client = p4_changelist_table_copy_column(src->client, count * sizeof(p4InternId));
+	target->desc = p4_changelist_table_copy_column(src->desc, count * sizeof(u32));
+	target->status = p4_changelist_table_copy_column(src->status, count);
+	target->changeType = p4_changelist_table_copy_column(src->changeType, count);
+	if(src->descriptions.count) {
+		bba_add_array(target->descriptions, src->descriptions.data, src->descriptions.count);
+	}
+	if(!target->change || !target->time || !target->user || !target->client || !target->desc || !target->status || !target->changeType ||
+	   (src->descriptions.count && !target->descriptions.data)) {
+		p4_changelist_table_reset(target);
+		return false;
+	}
+	target->count = count;
+	target->allocated = count;
+	return true;
+}
+
+static b32 p4_changelist_table_reserve(p4ChangelistTable *table, u32 count)
+{
+	if(!p4_changelist_table_own(table)) {
+		return false;
+	}
+	if(count <= table->allocated) {
+		return true;
+	}
+	u32 allocated = BB_MAX(count, table->allocated ? table->allocated * 2 : 1024);
+	b32 ok = p4_changelist_table_grow_column((void **)&table->change, allocated, sizeof(u32)) &&
+	         p4_changelist_table_grow_column((void **)&table->time, allocated, sizeof(u32)) &&
+	         p4_changelist_table_grow_column((void **)&table->user, allocated, sizeof(p4InternId)) &&
+	         p4_changelist_table_grow_column((void **)&table->client, allocated, sizeof(p4InternId)) &&
+	         p4_changelist_table_grow_column((void **)&table->desc, allocated, sizeof(u32)) &&
+	         p4_changelist_table_grow_column((void **)&table->status, allocated, sizeof(u8)) &&
+	         p4_changelist_table_grow_column((void **)&table->changeType, allocated, sizeof(u8));
+	if(ok) {
+		table->allocated = allocated;
+	}
+	return ok;
+}
+
+static u8 p4_changelist_table_lookup_enum(const char **names, u32 count, const char *value)
+{
+	for(u32 i = 0; i < count; ++i) {
+		if(!strcmp(names[i], value)) {
+			return (u8)i;
+		}
+	}
+	return 0;
+}
+
+u32 p4_changelist_table_add_record(p4ChangelistTable *table, const p4Records *records, u32 index)
+{
+	if(!p4_changelist_table_reserve(table, table->count + 1)) {
+		return ~0u;
+	}
+	u32 row = table->count++;
+	table->change[row] = strtou32(p4_record_find_safe(records, index, "change"));
+	table->time[row] = strtou32(p4_record_find_safe(records, index, "time"));
+	table->user[row] = p4_intern(p4_record_find_safe(records, index, "user"));
+	table->client[row] = p4_intern(p4_record_find_safe(records, index, "client"));
+	table->status[row] = p4_changelist_table_lookup_enum(s_changelistStatusNames, kP4ChangelistStatus_Count, p4_record_find_safe(records, index, "status"));
+	table->changeType[row] = p4_changelist_table_lookup_enum(s_changeTypeNames, kP4ChangeType_Count, p4_record_find_safe(records, index, "changeType"));
+	const char *desc = p4_record_find_safe(records, index, "desc");
+	table->desc[row] = table->descriptions.count;
+	bba_add_array(table->descriptions, desc, (u32)strlen(desc) + 1);
+	return row;
+}
+
+void p4_changelist_table_add_records(p4ChangelistTable *table, const p4Records *records)
+{
+	if(p4_changelist_table_reserve(table, table->count + records->count)) {
+		for(u32 i = 0; i < records->count; ++i) {
+			p4_changelist_table_add_record(table, records, i);
+		}
+	}
+}
+
+// the table has to own its columns - a changed description is appended, and the old one is left
+// in the blob until the table is next copied
+static void p4_changelist_table_set_row(p4ChangelistTable *table, u32 row, const p4ChangelistTable *src, u32 srcRow)
+{
+	table->change[row] = src->change[srcRow];
+	table->time[row] = src->time[srcRow];
+	table->user[row] = src->user[srcRow];
+	table->client[row] = src->client[srcRow];
+	table->status[row] = src->status[srcRow];
+	table->changeType[row] = src->changeType[srcRow];
+	const char *desc = p4_changelist_table_desc(src, srcRow);
+	table->desc[row] = table->descriptions.count;
+	bba_add_array(table->descriptions, desc, (u32)strlen(desc) + 1);
+}
+
+u32 p4_changelist_table_add_row(p4ChangelistTable *table, const p4ChangelistTable *src, u32 srcRow)
+{
+	if(srcRow >= src->count || !p4_changelist_table_reserve(table, table->count + 1)) {
+		return ~0u;
+	}
+	u32 row = table->count++;
+	p4_changelist_table_set_row(table, row, src, srcRow);
+	return row;
+}
+
+static void p4_changelist_table_move_row(p4ChangelistTable *table, u32 dst, u32 src)
+{
+	table->change[dst] = table->change[src];
+	table->time[dst] = table->time[src];
+	table->user[dst] = table->user[src];
+	table->client[dst] = table->client[src];
+	table->desc[dst] = table->desc[src];
+	table->status[dst] = table->status[src];
+	table->changeType[dst] = table->changeType[src];
+}
+
+static u64 p4_changelist_table_row_key(const p4ChangelistTable *table, u32 row)
+{
+	// default changelists are all change 0, one per client
+	return table->change[row] ? table->change[row] : (1ull << 32) | table->client[row];
+}
+
+static b32 p4_changelist_table_rows_equal(const p4ChangelistTable *a, u32 aRow, const p4ChangelistTable *b, u32 bRow)
+{
+	return a->time[aRow] == b->time[bRow] && a->user[aRow] == b->user[bRow] && a->client[aRow] == b->client[bRow] &&
+	       a->status[aRow] == b->status[bRow] && a->changeType[aRow] == b->changeType[bRow] &&
+	       !strcmp(p4_changelist_table_desc(a, aRow), p4_changelist_table_desc(b, bRow));
+}
+
+void p4_changelist_patch_reset(p4ChangelistPatch *patch)
+{
+	free(patch->remap);
+	free(patch->modified);
+	memset(patch, 0, sizeof(*patch));
+}
+
+p4ChangelistReconcile p4_changelist_table_reconcile(p4ChangelistTable *table, p4ChangelistTable *fresh, p4ChangelistPatch *patch)
+{
+	if(patch) {
+		p4_changelist_patch_reset(patch);
+	}
+
+	// fresh row index by key, in an open-addressed table at most half full
+	u32 numBuckets = 16;
+	while(numBuckets < fresh->count * 2) {
+		numBuckets *= 2;
+	}
+	u32 oldCount = table->count;
+	u32 *buckets = malloc(numBuckets * sizeof(u32));
+	u8 *matched = malloc(BB_MAX(fresh->count, 1u));
+	u32 *remap = malloc(BB_MAX(oldCount, 1u) * sizeof(u32)); // old row -> fresh row, then -> new row
+	b32 replace = !buckets || !matched || !remap;
+	u32 numRemoved = 0;
+	u32 numModified = 0;
+	if(!replace) {
+		memset(buckets, 0xff, numBuckets * sizeof(u32));
+		memset(matched, 0, BB_MAX(fresh->count, 1u));
+		u32 mask = numBuckets - 1;
+		for(u32 row = 0; row < fresh->count; ++row) {
+			u64 key = p4_changelist_table_row_key(fresh, row);
+			u32 bucket = (u32)(key * 11400714819323198485ull >> 32) & mask;
+			while(buckets[bucket] != ~0u) {
+				bucket = (bucket + 1) & mask;
+			}
+			buckets[bucket] = row;
+		}
+		for(u32 row = 0; row < oldCount; ++row) {
+			u64 key = p4_changelist_table_row_key(table, row);
+			u32 found = ~0u;
+			for(u32 bucket = (u32)(key * 11400714819323198485ull >> 32) & mask; buckets[bucket] != ~0u; bucket = (bucket + 1) & mask) {
+				if(p4_changelist_table_row_key(fresh, buckets[bucket]) == key) {
+					found = buckets[bucket];
+					break;
+				}
+			}
+			if(found == ~0u || matched[found]) {
+				remap[row] = ~0u;
+				++numRemoved;
+			} else {
+				matched[found] = true;
+				remap[row] = found;
+				if(!p4_changelist_table_rows_equal(table, row, fresh, found)) {
+					++numModified;
+				}
+			}
+		}
+		if(numRemoved || numModified) {
+			replace = !p4_changelist_table_own(table);
+		}
+	}
+
+	p4ChangelistReconcile result = kP4ChangelistReconcile_Unchanged;
+	u8 *modified = NULL;
+	if(!replace && (numRemoved || numModified)) {
+		// patch in place: drop removed rows, keeping the order of the rest, and update changed ones
+		modified = calloc(BB_MAX(fresh->count, 1u), 1);
+		replace = !modified;
+		if(!replace) {
+			u32 dst = 0;
+			for(u32 row = 0; row < oldCount; ++row) {
+				u32 freshRow = remap[row];
+				if(freshRow == ~0u) {
+					continue;
+				}
+				if(dst != row) {
+					p4_changelist_table_move_row(table, dst, row);
+				}
+				if(!p4_changelist_table_rows_equal(table, dst, fresh, freshRow)) {
+					p4_changelist_table_set_row(table, dst, fresh, freshRow);
+					modified[dst] = true;
+				}
+				remap[row] = dst++;
+			}
+			table->count = dst;
+			result = kP4ChangelistReconcile_Patched;
+		}
+	}
+
+	if(replace) {
+		p4_changelist_table_move(table, fresh);
+		result = kP4ChangelistReconcile_Replaced;
+		free(modified);
+		modified = NULL;
+	} else {
+		for(u32 row = 0; row < fresh->count; ++row) {
+			if(!matched[row]) {
+				p4_changelist_table_add_row(table, fresh, row);
+				if(result == kP4ChangelistReconcile_Unchanged) {
+					result = kP4ChangelistReconcile_Appended;
+				}
+			}
+		}
+		p4_changelist_table_reset(fresh);
+	}
+
+	if(patch && result == kP4ChangelistReconcile_Patched) {
+		patch->remap = remap;
+		patch->modified = modified;
+		patch->oldCount = oldCount;
+		patch->newCount = table->count;
+		remap = NULL;
+		modified = NULL;
+	}
+	free(buckets);
+	free(matched);
+	free(remap);
+	free(modified);
+	return result;
+}
+
+const char *p4_changelist_table_desc(const p4ChangelistTable *table, u32 row)
+{
+	return (row < table->count) ? table->descriptions.data + table->desc[row] : "";
+}
+
+const char *p4_changelist_table_string(const p4ChangelistTable *table, u32 row, p4ChangelistColumn column, char *buffer, u32 bufferSize)
+{
+	if(row >= table->count) {
+		return "";
+	}
+	switch(column) {
+	case kP4ChangelistColumn_Change:
+		if(!table->change[row]) {
+			return "default";
+		}
+		snprintf(buffer, bufferSize, "%u", table->change[row]);
+		return buffer;
+	case kP4ChangelistColumn_Time:
+		snprintf(buffer, bufferSize, "%u", table->time[row]);
+		return buffer;
+	case kP4ChangelistColumn_Client:
+		return p4_intern_string(table->client[row]);
+	case kP4ChangelistColumn_User:
+		return p4_intern_string(table->user[row]);
+	case kP4ChangelistColumn_Desc:
+		return p4_changelist_table_desc(table, row);
+	case kP4ChangelistColumn_Count:
+		break;
+	}
+	return "";
+}
+
+static sdictEntry_t p4_changelist_table_borrow_entry(const char *key, const char *value)
+{
+	sdictEntry_t entry = { 0 };
+	entry.key.data = (char *)key;
+	entry.key.count = (u32)strlen(key) + 1;
+	entry.value.data = (char *)value;
+	entry.value.count = (u32)strlen(value) + 1;
+	return entry;
+}
+
+void p4_changelist_table_view(const p4ChangelistTable *table, u32 row, sdict_t *view)
+{
+	view->count = 0;
+	if(row < table->count && bba_add_noclear(*view, 3)) {
+		view->data[0] = p4_changelist_table_borrow_entry("user", p4_intern_string(table->user[row]));
+		view->data[1] = p4_changelist_table_borrow_entry("client", p4_intern_string(table->client[row]));
+		view->data[2] = p4_changelist_table_borrow_entry("desc", p4_changelist_table_desc(table, row));
+	}
+}
+
+b32 p4_changelist_table_write(const p4ChangelistTable *table, u32 afterChange, pyWriter *writer)
+{
+	char buffer[16];
+	u32 written = 0;
+	for(u32 row = 0; row < table->count; ++row) {
+		if(table->change[row] <= afterChange) {
+			continue;
+		}
+		++written;
+		bba_push(*writer, '{');
+		p4_marshal_write_string(writer, "code");
+		p4_marshal_write_string(writer, "stat");
+		p4_marshal_write_string(writer, "change");
+		p4_marshal_write_string(writer, p4_changelist_table_string(table, row, kP4ChangelistColumn_Change, buffer, sizeof(buffer)));
+		p4_marshal_write_string(writer, "time");
+		p4_marshal_write_string(writer, p4_changelist_table_string(table, row, kP4ChangelistColumn_Time, buffer, sizeof(buffer)));
+		p4_marshal_write_string(writer, "user");
+		p4_marshal_write_string(writer, p4_intern_string(table->user[row]));
+		p4_marshal_write_string(writer, "client");
+		p4_marshal_write_string(writer, p4_intern_string(table->client[row]));
+		p4_marshal_write_string(writer, "status");
+		p4_marshal_write_string(writer, s_changelistStatusNames[table->status[row]]);
+		p4_marshal_write_string(writer, "changeType");
+		p4_marshal_write_string(writer, s_changeTypeNames[table->changeType[row]]);
+		p4_marshal_write_string(writer, "desc");
+		p4_marshal_write_string(writer, p4_changelist_table_desc(table, row));
+		bba_push(*writer, '0');
+	}
+	return writer->data != NULL || !written;
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "p4_intern.h"
+#include "p4_records.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Changelists from p4 changes, stored by column instead of as one dict per changelist.
+// Sorting, filtering and drawing rows read the typed columns directly, so a long history costs
+// a few loads per row instead of a string lookup and conversion per field.
+
+typedef enum tag_p4ChangelistColumn {
+	kP4ChangelistColumn_Change,
+	kP4ChangelistColumn_Time,
+	kP4ChangelistColumn_Client,
+	kP4ChangelistColumn_User,
+	kP4ChangelistColumn_Desc,
+	kP4ChangelistColumn_Count
+} p4ChangelistColumn;
+
+typedef enum tag_p4ChangelistStatus {
+	kP4ChangelistStatus_Submitted,
+	kP4ChangelistStatus_Pending,
+	kP4ChangelistStatus_Shelved,
+	kP4ChangelistStatus_Count
+} p4ChangelistStatus;
+
+typedef enum tag_p4ChangeType {
+	kP4ChangeType_Public,
+	kP4ChangeType_Restricted,
+	kP4ChangeType_Count
+} p4ChangeType;
+
+typedef struct tag_p4MappedFile p4MappedFile;
+
+typedef struct tag_p4ChangelistTable {
+	u32 count;
+	u32 allocated;
+	u32 *change; // 0 for default changelists
+	u32 *time;
+	p4InternId *user;
+	p4InternId *client;
+	u32 *desc;   // offset into descriptions
+	u8 *status;  // p4ChangelistStatus
+	u8 *changeType;
+	p4RecordStrings descriptions;
+	p4MappedFile *mapped; // if set, the columns other than user and client point into a snapshot (see p4_cache.h)
+} p4ChangelistTable;
+
+void p4_changelist_table_reset(p4ChangelistTable *table);
+void p4_changelist_table_move(p4ChangelistTable *target, p4ChangelistTable *src);
+
+// deep copy - target owns its columns even if src borrows them from a snapshot
+b32 p4_changelist_table_copy(p4ChangelistTable *target, const p4ChangelistTable *src);
+
+u32 p4_changelist_table_add_record(p4ChangelistTable *table, const p4Records *records, u32 index);
+void p4_changelist_table_add_records(p4ChangelistTable *table, const p4Records *records);
+u32 p4_changelist_table_add_row(p4ChangelistTable *table, const p4ChangelistTable *src, u32 srcRow);
+
+typedef enum tag_p4ChangelistReconcile {
+	kP4ChangelistReconcile_Unchanged,
+	kP4ChangelistReconcile_Appended, // rows were only added, at the end - existing row indices are still valid
+	kP4ChangelistReconcile_Patched,  // rows changed or went away in place, as described by the patch
+	kP4ChangelistReconcile_Replaced, // the table couldn't be patched (out of memory), so it was replaced
+} p4ChangelistReconcile;
+
+// what a patching reconcile did, so views can follow it instead of rebuilding.  Rows that are
+// still there keep their order, and new rows are added at the end as with Appended.
+typedef struct tag_p4ChangelistPatch {
+	u32 *remap;   // old row -> new row, or ~0u if it was removed
+	u8 *modified; // per new row - set if its fields changed
+	u32 oldCount;
+	u32 newCount;
+} p4ChangelistPatch;
+
+void p4_changelist_patch_reset(p4ChangelistPatch *patch);
+
+// brings table up to date with fresh, matching rows by change number (and client for default
+// changelists).  fresh is consumed.  patch (optional) receives the changes for a Patched result.
+p4ChangelistReconcile p4_changelist_table_reconcile(p4ChangelistTable *table, p4ChangelistTable *fresh, p4ChangelistPatch *patch);
+
+const char *p4_changelist_table_desc(const p4ChangelistTable *table, u32 row);
+
+// string form of a column, as p4 reports it - numbers are formatted into buffer
+const char *p4_changelist_table_string(const p4ChangelistTable *table, u32 row, p4ChangelistColumn column, char *buffer, u32 bufferSize);
+
+// fills view with the user, client and desc fields (borrowed) for sdict-based filters.
+// Release it with p4_record_view_reset.
+void p4_changelist_table_view(const p4ChangelistTable *table, u32 row, sdict_t *view);
+
+// writes rows with change numbers above afterChange back out as p4 -G changes records
+b32 p4_changelist_table_write(const p4ChangelistTable *table, u32 afterChange, pyWriter *writer);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,106 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_describe_store.h"
+#include "bb.h"
+#include "bb_array.h"
+#include "file_utils.h"
+#include "p4.h"
+#include "path_utils.h"
+#include "py_parser.h"
+#include "sb.h"
+
+#include <stdlib.h>
+
+typedef struct tag_p4DescribeStoreHeader {
+	u32 magic;
+	u32 version;
+	u32 change;
+	u32 time; // 0 for submitted changelists
+} p4DescribeStoreHeader;
+
+static const char *s_describeStoreKindNames[] = {
+	"describe",
+	"shelved",
+};
+BB_CTASSERT(BB_ARRAYSIZE(s_describeStoreKindNames) == kP4DescribeStore_Count);
+
+static sb_t s_createdDir; // the last shard directory created, so saves don't mkdir every time
+
+static sb_t p4_describe_store_path(p4DescribeStoreKind kind, u32 change, sb_t *dir)
+{
+	*dir = p4_cache_shard_path("p4_describes", NULL);
+	sb_t path = { 0 };
+	sb_va(&path, "%s\\%u.%s", sb_get(dir), change, s_describeStoreKindNames[kind]);
+	return path;
+}
+
+b32 p4_describe_store_load(p4DescribeStoreKind kind, u32 change, u32 time, sdict_t *sd)
+{
+	sb_t dir;
+	sb_t path = p4_describe_store_path(kind, change, &dir);
+	fileData_t fd = fileData_read(sb_get(&path));
+	b32 loaded = false;
+	if(fd.buffer && fd.bufferSize > sizeof(p4DescribeStoreHeader)) {
+		const p4DescribeStoreHeader *header = fd.buffer;
+		if(header->magic == kP4DescribeStore_Magic && header->version == kP4DescribeStore_Version && header->change == change && header->time == time) {
+			// describes have per-file keys (depotFile0..N etc), so they are parsed straight into an
+			// sdict rather than through p4Records, which shares keys across records
+			pyParser parser = { 0 };
+			sdicts dicts = { 0 };
+			bba_add_array(parser, (const char *)(header + 1), fd.bufferSize - sizeof(p4DescribeStoreHeader));
+			while(py_parser_tick(&parser, &dicts, false)) {
+				// do nothing
+			}
+			if(parser.data && parser.state != kParser_Error && parser.cursor == parser.count && dicts.count == 1) {
+				sdict_move(sd, dicts.data);
+				loaded = sd->count > 0;
+			} else {
+				BB_ERROR("p4::describe_store", "discarding damaged %s entry for %u", s_describeStoreKindNames[kind], change);
+				file_delete(sb_get(&path));
+			}
+			bba_free(parser);
+			sdict_reset(&parser.dict);
+			sdicts_reset(&dicts);
+		}
+	}
+	fileData_reset(&fd);
+	sb_reset(&path);
+	sb_reset(&dir);
+	return loaded;
+}
+
+void p4_describe_store_save(p4DescribeStoreKind kind, u32 change, u32 time, const sdict_t *sd)
+{
+	pyWriter writer = { 0 };
+	p4DescribeStoreHeader header = { kP4DescribeStore_Magic, kP4DescribeStore_Version, change, time };
+	bba_add_array(writer, (const char *)&header, sizeof(header));
+	sdicts dicts = { 0 };
+	dicts.count = dicts.allocated = 1;
+	dicts.data = (sdict_t *)sd; // only read - not freed
+	b32 serialized = writer.data && py_write_sdicts(&writer, &dicts);
+
+	sb_t dir;
+	sb_t path = p4_describe_store_path(kind, change, &dir);
+	if(serialized) {
+		if(strcmp(sb_get(&s_createdDir), sb_get(&dir))) {
+			path_mkdir(sb_get(&dir));
+			sb_reset(&s_createdDir);
+			sb_append(&s_createdDir, sb_get(&dir));
+		}
+		fileData_t fd = { 0 };
+		fd.buffer = writer.data;
+		fd.bufferSize = writer.count;
+		if(!fileData_write(sb_get(&path), NULL, fd)) {
+			BB_ERROR("p4::describe_store", "failed to write %s", sb_get(&path));
+		}
+	}
+	bba_free(writer);
+	sb_reset(&path);
+	sb_reset(&dir);
+}
+
+void p4_describe_store_shutdown(void)
+{
+	sb_reset(&s_createdDir);
+}
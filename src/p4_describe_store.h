@@ -0,0 +1,38 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "common.h"
+#include "sdict.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// describe results for a submitted changelist never change, so they're kept on disk and reused
+// across sessions instead of asking the server again.  Entries live in a directory per server and
+// user, one file per changelist and kind.  Pending changelists can still change, so their entries
+// are stamped with the changelist's update time and only match a lookup for that same time -
+// submitted entries use time 0.
+
+typedef enum tag_p4DescribeStoreKind {
+	kP4DescribeStore_Describe, // describe -s
+	kP4DescribeStore_Shelved,  // describe -s -S
+	kP4DescribeStore_Count
+} p4DescribeStoreKind;
+
+enum {
+	kP4DescribeStore_Magic = 0x53443450, // "P4DS"
+	kP4DescribeStore_Version = 1,
+};
+
+// fills sd (which should be empty) and returns true if there is an entry for change at time
+b32 p4_describe_store_load(p4DescribeStoreKind kind, u32 change, u32 time, sdict_t *sd);
+void p4_describe_store_save(p4DescribeStoreKind kind, u32 change, u32 time, const sdict_t *sd);
+
+void p4_describe_store_shutdown(void);
+
+#if defined(__cplusplus)
+}
+#endif
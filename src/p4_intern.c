@@ -0,0 +1,186 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_intern.h"
+#include "bb_criticalsection.h"
+
+#include <stdlib.h>
+
+// ids are (page << kIntern_PageShift) | offset, so strings never move and looking one up is two
+// loads.  Strings too long for a page get a page to themselves.
+enum {
+	kIntern_PageShift = 16,
+	kIntern_PageSize = 1 << kIntern_PageShift,
+	kIntern_MaxPages = 16 * 1024,
+	kIntern_InitialBuckets = 4096,
+};
+
+typedef struct tag_p4InternTable {
+	bb_critical_section cs; // protects everything but reading pages
+	char *pages[kIntern_MaxPages];
+	u32 numPages;
+	u32 pageUsed; // bytes used in the last page
+	p4InternId *buckets;
+	u32 numBuckets;
+	u32 count;
+	b32 initialized;
+	u8 pad[4];
+} p4InternTable;
+
+static p4InternTable s_intern;
+
+static u32 p4_intern_hash(const char *str, u32 len)
+{
+	u32 hash = 2166136261u;
+	for(u32 i = 0; i < len; ++i) {
+		hash = (hash ^ (u8)str[i]) * 16777619u;
+	}
+	return hash;
+}
+
+const char *p4_intern_string(p4InternId id)
+{
+	u32 page = id >> kIntern_PageShift;
+	if(id == ~0u || page >= s_intern.numPages) {
+		return "";
+	}
+	return s_intern.pages[page] + (id & (kIntern_PageSize - 1));
+}
+
+static b32 p4_intern_matches(p4InternId id, const char *str, u32 len)
+{
+	const char *existing = p4_intern_string(id);
+	return !strncmp(existing, str, len) && !existing[len];
+}
+
+// called with the lock held
+static p4InternId p4_intern_find_locked(const char *str, u32 len, u32 hash)
+{
+	if(!s_intern.numBuckets) {
+		return ~0u;
+	}
+	u32 mask = s_intern.numBuckets - 1;
+	for(u32 bucket = hash & mask;; bucket = (bucket + 1) & mask) {
+		p4InternId id = s_intern.buckets[bucket];
+		if(id == ~0u) {
+			return ~0u;
+		}
+		if(p4_intern_matches(id, str, len)) {
+			return id;
+		}
+	}
+}
+
+static void p4_intern_insert_bucket(p4InternId *buckets, u32 numBuckets, p4InternId id)
+{
+	const char *str = p4_intern_string(id);
+	u32 mask = numBuckets - 1;
+	u32 bucket = p4_intern_hash(str, (u32)strlen(str)) & mask;
+	while(buckets[bucket] != ~0u) {
+		bucket = (bucket + 1) & mask;
+	}
+	buckets[bucket] = id;
+}
+
+static b32 p4_intern_grow_buckets(void)
+{
+	u32 numBuckets = s_intern.numBuckets ? s_intern.numBuckets * 2 : kIntern_InitialBuckets;
+	p4InternId *buckets = malloc(numBuckets * sizeof(p4InternId));
+	if(!buckets) {
+		return false;
+	}
+	memset(buckets, 0xff, numBuckets * sizeof(p4InternId)); // ~0u is an empty bucket
+	for(u32 i = 0; i < s_intern.numBuckets; ++i) {
+		if(s_intern.buckets[i] != ~0u) {
+			p4_intern_insert_bucket(buckets, numBuckets, s_intern.buckets[i]);
+		}
+	}
+	free(s_intern.buckets);
+	s_intern.buckets = buckets;
+	s_intern.numBuckets = numBuckets;
+	return true;
+}
+
+// called with the lock held
+static p4InternId p4_intern_store(const char *str, u32 len)
+{
+	u32 required = len + 1;
+	if(!s_intern.numPages || s_intern.pageUsed + required > kIntern_PageSize) {
+		if(s_intern.numPages >= kIntern_MaxPages) {
+			return ~0u;
+		}
+		char *page = malloc(BB_MAX(required, (u32)kIntern_PageSize));
+		if(!page) {
+			return ~0u;
+		}
+		s_intern.pages[s_intern.numPages++] = page;
+		s_intern.pageUsed = 0;
+	}
+	u32 offset = s_intern.pageUsed;
+	char *dst = s_intern.pages[s_intern.numPages - 1] + offset;
+	memcpy(dst, str, len);
+	dst[len] = '\0';
+	s_intern.pageUsed += required;
+	return ((s_intern.numPages - 1) << kIntern_PageShift) | offset;
+}
+
+void p4_intern_startup(void)
+{
+	if(!s_intern.initialized) {
+		bb_critical_section_init(&s_intern.cs);
+		s_intern.initialized = true;
+		p4_intern(""); // kP4InternId_Empty
+	}
+}
+
+void p4_intern_shutdown(void)
+{
+	if(s_intern.initialized) {
+		for(u32 i = 0; i < s_intern.numPages; ++i) {
+			free(s_intern.pages[i]);
+		}
+		free(s_intern.buckets);
+		bb_critical_section_shutdown(&s_intern.cs);
+		memset(&s_intern, 0, sizeof(s_intern));
+	}
+}
+
+p4InternId p4_intern_range(const char *start, const char *end)
+{
+	if(!s_intern.initialized) {
+		return ~0u;
+	}
+	u32 len = (u32)(end - start);
+	u32 hash = p4_intern_hash(start, len);
+	bb_critical_section_lock(&s_intern.cs);
+	p4InternId id = p4_intern_find_locked(start, len, hash);
+	if(id == ~0u) {
+		if((s_intern.count + 1) * 2 <= s_intern.numBuckets || p4_intern_grow_buckets()) {
+			id = p4_intern_store(start, len);
+			if(id != ~0u) {
+				p4_intern_insert_bucket(s_intern.buckets, s_intern.numBuckets, id);
+				++s_intern.count;
+			}
+		}
+	}
+	bb_critical_section_unlock(&s_intern.cs);
+	return id;
+}
+
+p4InternId p4_intern(const char *str)
+{
+	return p4_intern_range(str, str + strlen(str));
+}
+
+p4InternId p4_intern_find(const char *str)
+{
+	if(!s_intern.initialized) {
+		return ~0u;
+	}
+	u32 len = (u32)strlen(str);
+	u32 hash = p4_intern_hash(str, len);
+	bb_critical_section_lock(&s_intern.cs);
+	p4InternId id = p4_intern_find_locked(str, len, hash);
+	bb_critical_section_unlock(&s_intern.cs);
+	return id;
+}
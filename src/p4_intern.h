@@ -0,0 +1,34 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "common.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Process-wide string interning for strings that repeat across hundreds of thousands of records:
+// user and client names, depot paths, file actions and types.  Each distinct string is stored
+// once and never moves or gets freed until shutdown, so ids compare equal exactly when the strings
+// do, and the string pointers can be held onto.
+// Interning is thread-safe - looking up a string from an id doesn't take a lock.
+
+typedef u32 p4InternId;
+
+enum {
+	kP4InternId_Empty = 0, // ""
+};
+
+void p4_intern_startup(void);
+void p4_intern_shutdown(void);
+
+p4InternId p4_intern(const char *str);
+p4InternId p4_intern_range(const char *start, const char *end);
+p4InternId p4_intern_find(const char *str); // ~0u if the string hasn't been interned
+const char *p4_intern_string(p4InternId id);
+
+#if defined(__cplusplus)
+}
+#endif
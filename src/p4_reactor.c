@@ -0,0 +1,292 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_reactor.h"
+#include "bb_array.h"
+#include "bb_criticalsection.h"
+#include "bbthread.h"
+#include "imgui_core.h"
+#include "p4_task.h"
+#include "p4_telemetry.h"
+
+// Parsing happens with only the job's ioLock held, so the main thread collecting from one job
+// never waits on another job's parsing, or on its own.  Results are published under the job's
+// lock, which is only held long enough to move them.
+struct tag_p4ReactorJob {
+	// reactor thread only, with ioLock held - detach takes it too, so it only waits on a read of
+	// this job that is already under way
+	bb_critical_section ioLock;
+	process_t *process;
+	p4Records *records; // owned by the task, but only touched here until the job is detached
+	pyParser parser;
+	sdicts decoded; // parsed but not yet published
+	sb_t stderrDecoded;
+	b32 detached;
+	b32 exited;
+
+	// published to the main thread with lock held
+	bb_critical_section lock;
+	sdicts parsedDicts; // decoded but not yet collected by the main thread
+	sb_t stderrText;
+	b32 done;
+
+	// protected by the reactor's lock - the reactor thread holds a reference while it pumps the job
+	u32 refs;
+	b32 freeOnRelease;
+	u32 telemetryId;
+};
+
+typedef struct tag_p4ReactorJobs {
+	u32 count;
+	u32 allocated;
+	p4ReactorJob **data;
+} p4ReactorJobs;
+
+typedef struct tag_p4Reactor {
+	bb_critical_section cs; // protects the jobs list and job refs - never held while reading or parsing
+	p4ReactorJobs jobs;
+	HANDLE wakeEvent;
+	bb_thread_handle_t thread;
+	b32 running;
+	b32 shutdownRequested;
+} p4Reactor;
+
+static p4Reactor s_reactor;
+
+enum {
+	// process_tick reads anonymous pipes without blocking, so while processes are running the
+	// thread polls them - otherwise it sleeps until a job is attached.
+	kReactor_PollMs = 2,
+};
+
+static void p4_reactor_free_job(p4ReactorJob *job)
+{
+	sdicts_reset(&job->decoded);
+	sdicts_reset(&job->parsedDicts);
+	sdict_reset(&job->parser.dict);
+	bba_free(job->parser);
+	sb_reset(&job->stderrDecoded);
+	sb_reset(&job->stderrText);
+	bb_critical_section_shutdown(&job->ioLock);
+	bb_critical_section_shutdown(&job->lock);
+	free(job);
+}
+
+static void p4_reactor_publish(p4ReactorJob *job)
+{
+	bb_critical_section_lock(&job->lock);
+	if(job->decoded.count) {
+		// sdict_t is moved bitwise - the decoded array gives up ownership of the entries
+		bba_add_array(job->parsedDicts, job->decoded.data, job->decoded.count);
+		job->decoded.count = 0;
+	}
+	if(job->stderrDecoded.count) {
+		sb_append(&job->stderrText, sb_get(&job->stderrDecoded));
+		sb_reset(&job->stderrDecoded);
+	}
+	job->done = job->exited;
+	bb_critical_section_unlock(&job->lock);
+}
+
+// called with the job's ioLock held - returns true if any output was read
+static b32 p4_reactor_pump(p4ReactorJob *job)
+{
+	processTickResult_t res = process_tick(job->process);
+	if(res.stdoutIO.nBytes) {
+		u64 parseStart = p4_telemetry_ticks();
+		u32 prevRecords = job->records ? job->records->count : job->decoded.count;
+		bba_add_array(job->parser, res.stdoutIO.buffer, res.stdoutIO.nBytes);
+		if(job->records) {
+			p4_parser_decode_records(&job->parser, job->records);
+		} else {
+			while(py_parser_tick(&job->parser, &job->decoded, false)) {
+				// do nothing
+			}
+		}
+		p4_parser_compact(&job->parser);
+		job->process->stdoutBuffer.count = 0;
+		u32 records = (job->records ? job->records->count : job->decoded.count) - prevRecords;
+		p4_telemetry_output(job->telemetryId, res.stdoutIO.nBytes, records, p4_telemetry_ticks() - parseStart);
+	}
+	if(res.stderrIO.nBytes) {
+		sb_va(&job->stderrDecoded, "%.*s\n", res.stderrIO.nBytes, res.stderrIO.buffer);
+	}
+	if(res.done) {
+		job->exited = true;
+	}
+	if(job->decoded.count || job->stderrDecoded.count || job->exited) {
+		p4_reactor_publish(job);
+	}
+	return res.stdoutIO.nBytes || res.stderrIO.nBytes || res.done;
+}
+
+static bb_thread_return_t p4_reactor_thread(void *args)
+{
+	BB_UNUSED(args);
+	bbthread_set_name("p4_reactor");
+	p4ReactorJobs pumping = { 0 };
+	p4ReactorJobs released = { 0 };
+	while(!s_reactor.shutdownRequested) {
+		b32 active = false;
+		b32 progress = false;
+		bb_critical_section_lock(&s_reactor.cs);
+		pumping.count = 0;
+		for(u32 i = 0; i < s_reactor.jobs.count; ++i) {
+			p4ReactorJob *job = s_reactor.jobs.data[i];
+			++job->refs;
+			bba_push(pumping, job);
+		}
+		bb_critical_section_unlock(&s_reactor.cs);
+
+		for(u32 i = 0; i < pumping.count; ++i) {
+			p4ReactorJob *job = pumping.data[i];
+			bb_critical_section_lock(&job->ioLock);
+			if(!job->detached && !job->exited) {
+				progress = p4_reactor_pump(job) || progress;
+				active = active || !job->exited;
+			}
+			bb_critical_section_unlock(&job->ioLock);
+		}
+
+		released.count = 0;
+		bb_critical_section_lock(&s_reactor.cs);
+		for(u32 i = 0; i < pumping.count; ++i) {
+			p4ReactorJob *job = pumping.data[i];
+			if(!--job->refs && job->freeOnRelease) {
+				bba_push(released, job);
+			}
+		}
+		bb_critical_section_unlock(&s_reactor.cs);
+		for(u32 i = 0; i < released.count; ++i) {
+			p4_reactor_free_job(released.data[i]);
+		}
+
+		if(progress) {
+			Imgui_Core_RequestRender();
+		} else {
+			WaitForSingleObject(s_reactor.wakeEvent, active ? kReactor_PollMs : INFINITE);
+		}
+	}
+	bba_free(pumping);
+	bba_free(released);
+	return 0;
+}
+
+b32 p4_reactor_startup(void)
+{
+	if(s_reactor.running) {
+		return true;
+	}
+	s_reactor.wakeEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
+	if(!s_reactor.wakeEvent) {
+		BB_ERROR("p4::reactor", "failed to create wake event - p4 output will be read on the main thread");
+		return false;
+	}
+	bb_critical_section_init(&s_reactor.cs);
+	s_reactor.shutdownRequested = false;
+	s_reactor.thread = bbthread_create(p4_reactor_thread, NULL);
+	if(!s_reactor.thread) {
+		BB_ERROR("p4::reactor", "failed to create thread - p4 output will be read on the main thread");
+		bb_critical_section_shutdown(&s_reactor.cs);
+		CloseHandle(s_reactor.wakeEvent);
+		s_reactor.wakeEvent = NULL;
+		return false;
+	}
+	s_reactor.running = true;
+	return true;
+}
+
+void p4_reactor_shutdown(void)
+{
+	if(!s_reactor.running) {
+		return;
+	}
+	s_reactor.shutdownRequested = true;
+	SetEvent(s_reactor.wakeEvent);
+	bbthread_join(s_reactor.thread);
+	s_reactor.thread = 0;
+	s_reactor.running = false;
+
+	// tasks normally detach in task_p4_reset, but anything left over is abandoned here
+	for(u32 i = 0; i < s_reactor.jobs.count; ++i) {
+		p4_reactor_free_job(s_reactor.jobs.data[i]);
+	}
+	bba_free(s_reactor.jobs);
+	bb_critical_section_shutdown(&s_reactor.cs);
+	CloseHandle(s_reactor.wakeEvent);
+	s_reactor.wakeEvent = NULL;
+}
+
+p4ReactorJob *p4_reactor_attach(process_t *process, p4Records *records, u32 telemetryId)
+{
+	if(!s_reactor.running || !process) {
+		return NULL;
+	}
+	p4ReactorJob *job = malloc(sizeof(p4ReactorJob));
+	if(!job) {
+		return NULL;
+	}
+	memset(job, 0, sizeof(*job));
+	job->process = process;
+	job->records = records;
+	job->telemetryId = telemetryId;
+	bb_critical_section_init(&job->ioLock);
+	bb_critical_section_init(&job->lock);
+
+	bb_critical_section_lock(&s_reactor.cs);
+	bba_push(s_reactor.jobs, job);
+	bb_critical_section_unlock(&s_reactor.cs);
+
+	SetEvent(s_reactor.wakeEvent);
+	return job;
+}
+
+b32 p4_reactor_collect(p4ReactorJob *job, sdicts *parsedDicts, sb_t *stderrText)
+{
+	bb_critical_section_lock(&job->lock);
+	if(job->parsedDicts.count) {
+		// sdict_t is moved bitwise - the job gives up ownership of the entries
+		bba_add_array(*parsedDicts, job->parsedDicts.data, job->parsedDicts.count);
+		job->parsedDicts.count = 0;
+	}
+	if(job->stderrText.count) {
+		sb_append(stderrText, sb_get(&job->stderrText));
+		sb_reset(&job->stderrText);
+	}
+	b32 done = job->done;
+	bb_critical_section_unlock(&job->lock);
+	return done;
+}
+
+void p4_reactor_detach(p4ReactorJob *job, pyParser *parser)
+{
+	bb_critical_section_lock(&s_reactor.cs);
+	for(u32 i = 0; i < s_reactor.jobs.count; ++i) {
+		if(s_reactor.jobs.data[i] == job) {
+			bba_erase(s_reactor.jobs, i);
+			break;
+		}
+	}
+	bb_critical_section_unlock(&s_reactor.cs);
+
+	// waits for a read that is already under way - after this the reactor won't touch the
+	// process, the task's records or the parser
+	bb_critical_section_lock(&job->ioLock);
+	job->detached = true;
+	if(parser) {
+		sdict_reset(&parser->dict);
+		bba_free(*parser);
+		*parser = job->parser;
+		memset(&job->parser, 0, sizeof(job->parser));
+	}
+	bb_critical_section_unlock(&job->ioLock);
+
+	// the reactor thread frees the job if it still holds a reference
+	bb_critical_section_lock(&s_reactor.cs);
+	b32 release = job->refs == 0;
+	job->freeOnRelease = !release;
+	bb_critical_section_unlock(&s_reactor.cs);
+	if(release) {
+		p4_reactor_free_job(job);
+	}
+}
@@ -0,0 +1,40 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "p4_records.h"
+#include "process_utils.h"
+#include "py_parser.h"
+#include "sdict.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// The reactor is a single background thread that drains the stdout/stderr pipes of every running
+// p4 process and decodes the marshal stream as it arrives, so large queries finish at pipe speed
+// instead of one chunk per rendered frame.  The main thread collects decoded records each tick.
+typedef struct tag_p4ReactorJob p4ReactorJob;
+
+b32 p4_reactor_startup(void);
+void p4_reactor_shutdown(void);
+
+// the reactor owns the process's I/O until the job is detached - the caller must not call
+// process_tick on it in the meantime.  If records is set, output is decoded into it instead of
+// being handed back by p4_reactor_collect, and it must not be touched until the job is detached.
+// Output and parse time are reported to telemetryId (see p4_telemetry.h).
+// Returns NULL if the reactor isn't running.
+p4ReactorJob *p4_reactor_attach(process_t *process, p4Records *records, u32 telemetryId);
+
+// moves records decoded since the last collect to the end of parsedDicts, and appends any stderr
+// output to stderrText.  Returns true once the process has exited and everything has been collected.
+b32 p4_reactor_collect(p4ReactorJob *job, sdicts *parsedDicts, sb_t *stderrText);
+
+// stops the reactor from touching the process and frees the job.  The parser state (unparsed
+// tail, error state) is moved to parser so failed parses can still be inspected.
+void p4_reactor_detach(p4ReactorJob *job, pyParser *parser);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,269 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_records.h"
+#include "bb_array.h"
+
+#include <stdio.h>
+
+void p4_records_reset(p4Records *records)
+{
+	bba_free(*records);
+	bba_free(records->fields);
+	bba_free(records->strings);
+	bba_free(records->keys);
+}
+
+void p4_records_move(p4Records *target, p4Records *src)
+{
+	p4_records_reset(target);
+	*target = *src;
+	memset(src, 0, sizeof(*src));
+}
+
+static u32 p4_records_add_string(p4Records *records, const char *str, u32 len)
+{
+	u32 offset = records->strings.count;
+	if(len) {
+		bba_add_array(records->strings, str, len);
+	}
+	bba_push(records->strings, '\0');
+	return offset;
+}
+
+static u32 p4_records_add_key(p4Records *records, const char *key, u32 len)
+{
+	for(u32 i = 0; i < records->keys.count; ++i) {
+		const char *existing = records->strings.data + records->keys.data[i];
+		if(!strncmp(existing, key, len) && !existing[len]) {
+			return records->keys.data[i];
+		}
+	}
+	u32 offset = p4_records_add_string(records, key, len);
+	bba_push(records->keys, offset);
+	return offset;
+}
+
+static u32 p4_records_find_key(const p4Records *records, const char *key)
+{
+	for(u32 i = 0; i < records->keys.count; ++i) {
+		if(!strcmp(records->strings.data + records->keys.data[i], key)) {
+			return records->keys.data[i];
+		}
+	}
+	return ~0u;
+}
+
+static void p4_records_add_field(p4Records *records, u32 key, const char *value, u32 len)
+{
+	p4RecordField field = { key, p4_records_add_string(records, value, len) };
+	bba_push(records->fields, field);
+}
+
+u32 p4_records_add_sdict(p4Records *records, const sdict_t *sd)
+{
+	p4Record record = { records->fields.count, 0 };
+	for(u32 i = 0; i < sd->count; ++i) {
+		const sdictEntry_t *entry = sd->data + i;
+		const char *key = sb_get(&entry->key);
+		const char *value = sb_get(&entry->value);
+		p4_records_add_field(records, p4_records_add_key(records, key, (u32)strlen(key)), value, (u32)strlen(value));
+		++record.numFields;
+	}
+	bba_push(*records, record);
+	return records->count - 1;
+}
+
+u32 p4_records_add_record(p4Records *records, const p4Records *src, u32 index)
+{
+	const p4Record *srcRecord = src->data + index;
+	p4Record record = { records->fields.count, srcRecord->numFields };
+	for(u32 i = 0; i < srcRecord->numFields; ++i) {
+		const p4RecordField *field = src->fields.data + srcRecord->firstField + i;
+		const char *key = src->strings.data + field->key;
+		const char *value = src->strings.data + field->value;
+		p4_records_add_field(records, p4_records_add_key(records, key, (u32)strlen(key)), value, (u32)strlen(value));
+	}
+	bba_push(*records, record);
+	return records->count - 1;
+}
+
+const char *p4_record_find(const p4Records *records, u32 index, const char *key)
+{
+	if(index >= records->count) {
+		return NULL;
+	}
+	u32 keyOffset = p4_records_find_key(records, key);
+	if(keyOffset == ~0u) {
+		return NULL;
+	}
+	const p4Record *record = records->data + index;
+	const p4RecordField *fields = records->fields.data + record->firstField;
+	for(u32 i = 0; i < record->numFields; ++i) {
+		if(fields[i].key == keyOffset) {
+			return records->strings.data + fields[i].value;
+		}
+	}
+	return NULL;
+}
+
+const char *p4_record_find_safe(const p4Records *records, u32 index, const char *key)
+{
+	const char *value = p4_record_find(records, index, key);
+	return value ? value : "";
+}
+
+static sb_t p4_record_borrow_string(const p4Records *records, u32 offset)
+{
+	sb_t sb = { 0 };
+	sb.data = records->strings.data + offset;
+	sb.count = (u32)strlen(sb.data) + 1;
+	return sb;
+}
+
+void p4_record_view(const p4Records *records, u32 index, sdict_t *view)
+{
+	view->count = 0;
+	if(index >= records->count) {
+		return;
+	}
+	const p4Record *record = records->data + index;
+	if(bba_add_noclear(*view, record->numFields)) {
+		for(u32 i = 0; i < record->numFields; ++i) {
+			const p4RecordField *field = records->fields.data + record->firstField + i;
+			sdictEntry_t *entry = view->data + i;
+			entry->key = p4_record_borrow_string(records, field->key);
+			entry->value = p4_record_borrow_string(records, field->value);
+		}
+	}
+}
+
+void p4_record_view_reset(sdict_t *view)
+{
+	// the entries don't own their strings, so only the entry array is freed
+	bba_free(*view);
+}
+
+typedef enum tag_p4MarshalRead {
+	kMarshalRead_Ok,
+	kMarshalRead_Partial,
+	kMarshalRead_Invalid,
+} p4MarshalRead;
+
+static p4MarshalRead p4_marshal_read_u32(const char *data, u32 count, u32 *cursor, u32 *value)
+{
+	if(count - *cursor < 4) {
+		return kMarshalRead_Partial;
+	}
+	const u8 *bytes = (const u8 *)data + *cursor;
+	*value = (u32)bytes[0] | ((u32)bytes[1] << 8) | ((u32)bytes[2] << 16) | ((u32)bytes[3] << 24);
+	*cursor += 4;
+	return kMarshalRead_Ok;
+}
+
+// reads a string or int object - ints are converted to strings, since that's how sdicts see them
+static p4MarshalRead p4_marshal_read_value(const char *data, u32 count, u32 *cursor, const char **str, u32 *len, char *intBuffer, u32 intBufferSize)
+{
+	if(*cursor >= count) {
+		return kMarshalRead_Partial;
+	}
+	char type = data[(*cursor)++];
+	u32 value = 0;
+	p4MarshalRead res = p4_marshal_read_u32(data, count, cursor, &value);
+	if(res != kMarshalRead_Ok) {
+		return res;
+	}
+	if(type == 's') {
+		if(count - *cursor < value) {
+			return kMarshalRead_Partial;
+		}
+		*str = data + *cursor;
+		*len = value;
+		*cursor += value;
+		return kMarshalRead_Ok;
+	} else if(type == 'i') {
+		int written = snprintf(intBuffer, intBufferSize, "%d", (s32)value);
+		*str = intBuffer;
+		*len = (written > 0) ? (u32)written : 0;
+		return kMarshalRead_Ok;
+	}
+	return kMarshalRead_Invalid;
+}
+
+b32 p4_records_parse(p4Records *records, const char *data, u32 count, u32 *consumed)
+{
+	u32 pos = 0;
+	*consumed = 0;
+	while(pos < count) {
+		if(data[pos] != '{') {
+			return false;
+		}
+
+		u32 prevStrings = records->strings.count;
+		u32 prevFields = records->fields.count;
+		u32 prevKeys = records->keys.count;
+		p4Record record = { records->fields.count, 0 };
+		p4MarshalRead res = kMarshalRead_Partial;
+		u32 cursor = pos + 1;
+		while(cursor < count) {
+			if(data[cursor] == '0') {
+				++cursor;
+				res = kMarshalRead_Ok;
+				break;
+			}
+			char keyBuffer[16];
+			char valueBuffer[16];
+			const char *key = NULL;
+			const char *value = NULL;
+			u32 keyLen = 0;
+			u32 valueLen = 0;
+			res = p4_marshal_read_value(data, count, &cursor, &key, &keyLen, keyBuffer, sizeof(keyBuffer));
+			if(res == kMarshalRead_Ok) {
+				res = p4_marshal_read_value(data, count, &cursor, &value, &valueLen, valueBuffer, sizeof(valueBuffer));
+			}
+			if(res != kMarshalRead_Ok) {
+				break;
+			}
+			p4_records_add_field(records, p4_records_add_key(records, key, keyLen), value, valueLen);
+			++record.numFields;
+			res = kMarshalRead_Partial;
+		}
+
+		if(res != kMarshalRead_Ok) {
+			// roll back the partial record - it will be parsed again once the rest arrives
+			records->strings.count = prevStrings;
+			records->fields.count = prevFields;
+			records->keys.count = prevKeys;
+			return res != kMarshalRead_Invalid;
+		}
+		bba_push(*records, record);
+		pos = cursor;
+		*consumed = pos;
+	}
+	return true;
+}
+
+void p4_marshal_write_string(pyWriter *writer, const char *str)
+{
+	u32 len = (u32)strlen(str);
+	u8 header[5] = { 's', (u8)len, (u8)(len >> 8), (u8)(len >> 16), (u8)(len >> 24) };
+	bba_add_array(*writer, (const char *)header, sizeof(header));
+	if(len) {
+		bba_add_array(*writer, str, len);
+	}
+}
+
+b32 p4_records_write(const p4Records *records, pyWriter *writer)
+{
+	for(u32 i = 0; i < records->count; ++i) {
+		const p4Record *record = records->data + i;
+		bba_push(*writer, '{');
+		for(u32 j = 0; j < record->numFields; ++j) {
+			const p4RecordField *field = records->fields.data + record->firstField + j;
+			p4_marshal_write_string(writer, records->strings.data + field->key);
+			p4_marshal_write_string(writer, records->strings.data + field->value);
+		}
+		bba_push(*writer, '0');
+	}
+	return writer->data != NULL || !records->count;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "py_parser.h"
+#include "sdict.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// A set of parsed p4 records (the dicts from p4 -G) stored in a handful of flat arrays instead
+// of one allocation per key and value.  Strings live NUL-terminated in a shared string arena and
+// fields refer to them by offset, so the whole set is freed (or moved) in one shot.
+// Keys are stored once per set - a changeset with 500k records has a handful of key strings.
+
+typedef struct tag_p4RecordField {
+	u32 key;   // offset into strings
+	u32 value; // offset into strings
+} p4RecordField;
+
+typedef struct tag_p4RecordFields {
+	u32 count;
+	u32 allocated;
+	p4RecordField *data;
+} p4RecordFields;
+
+typedef struct tag_p4Record {
+	u32 firstField;
+	u32 numFields;
+} p4Record;
+
+typedef struct tag_p4RecordStrings {
+	u32 count;
+	u32 allocated;
+	char *data;
+} p4RecordStrings;
+
+typedef struct tag_p4RecordKeys {
+	u32 count;
+	u32 allocated;
+	u32 *data; // offsets into strings
+} p4RecordKeys;
+
+typedef struct tag_p4Records {
+	u32 count;
+	u32 allocated;
+	p4Record *data;
+	p4RecordFields fields;
+	p4RecordStrings strings;
+	p4RecordKeys keys;
+} p4Records;
+
+void p4_records_reset(p4Records *records);
+void p4_records_move(p4Records *target, p4Records *src);
+
+u32 p4_records_add_sdict(p4Records *records, const sdict_t *sd);
+u32 p4_records_add_record(p4Records *records, const p4Records *src, u32 index);
+
+const char *p4_record_find(const p4Records *records, u32 index, const char *key);
+const char *p4_record_find_safe(const p4Records *records, u32 index, const char *key);
+
+// fills view with entries that borrow the record's strings, for code that only reads sdicts
+// (filters etc).  The view is only valid until records changes, and must be released with
+// p4_record_view_reset rather than sdict_reset.
+void p4_record_view(const p4Records *records, u32 index, sdict_t *view);
+void p4_record_view_reset(sdict_t *view);
+
+// decodes complete marshalled dicts from data straight into the arena.  consumed is set to the
+// number of bytes used - a partial record at the end is left for the next call.
+// Returns false if the data isn't a stream of marshalled dicts.
+b32 p4_records_parse(p4Records *records, const char *data, u32 count, u32 *consumed);
+
+// writes records in the same marshal format p4 -G produces (and py_parser reads)
+b32 p4_records_write(const p4Records *records, pyWriter *writer);
+void p4_marshal_write_string(pyWriter *writer, const char *str);
+
+#if defined(__cplusplus)
+}
+#endif
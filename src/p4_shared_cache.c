@@ -0,0 +1,105 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_shared_cache.h"
+#include "bb.h"
+#include "sb.h"
+#include "va.h"
+
+typedef struct tag_p4SharedCache {
+	sb_t key;
+	HANDLE writerMutex;  // owned by the writer, on the main thread
+	HANDLE refreshEvent; // auto-reset, set by readers
+	b32 writer;
+	u8 pad[4];
+} p4SharedCache;
+
+static p4SharedCache s_sharedCache;
+
+static void p4_shared_cache_release(void)
+{
+	if(s_sharedCache.writer) {
+		ReleaseMutex(s_sharedCache.writerMutex);
+		s_sharedCache.writer = false;
+	}
+	if(s_sharedCache.writerMutex) {
+		CloseHandle(s_sharedCache.writerMutex);
+		s_sharedCache.writerMutex = NULL;
+	}
+	if(s_sharedCache.refreshEvent) {
+		CloseHandle(s_sharedCache.refreshEvent);
+		s_sharedCache.refreshEvent = NULL;
+	}
+	sb_reset(&s_sharedCache.key);
+}
+
+// kernel object names can't contain backslashes, and paths are case insensitive
+static u32 p4_shared_cache_hash(const char *key)
+{
+	u32 hash = 2166136261u;
+	for(const char *c = key; *c; ++c) {
+		char ch = (*c >= 'A' && *c <= 'Z') ? *c - 'A' + 'a' : *c;
+		hash = (hash ^ (u8)ch) * 16777619u;
+	}
+	return hash;
+}
+
+b32 p4_shared_cache_elect(const char *key)
+{
+	if(strcmp(sb_get(&s_sharedCache.key), key)) {
+		p4_shared_cache_release();
+		sb_append(&s_sharedCache.key, key);
+		u32 hash = p4_shared_cache_hash(key);
+		s_sharedCache.writerMutex = CreateMutexA(NULL, FALSE, va("Local\\p4t_cache_%08x_writer", hash));
+		s_sharedCache.refreshEvent = CreateEventA(NULL, FALSE, FALSE, va("Local\\p4t_cache_%08x_refresh", hash));
+		if(!s_sharedCache.writerMutex) {
+			// without the mutex there is no way to coordinate, so behave as if alone
+			BB_ERROR("p4::shared_cache", "failed to create writer mutex for %s - error %u", key, (u32)GetLastError());
+			s_sharedCache.writer = true;
+			return true;
+		}
+	}
+	if(!s_sharedCache.writer && s_sharedCache.writerMutex) {
+		// an abandoned mutex means the previous writer exited without releasing it
+		DWORD result = WaitForSingleObject(s_sharedCache.writerMutex, 0);
+		if(result == WAIT_OBJECT_0 || result == WAIT_ABANDONED) {
+			s_sharedCache.writer = true;
+			BB_LOG("p4::shared_cache", "elected writer for %s", key);
+		}
+	}
+	return s_sharedCache.writer;
+}
+
+b32 p4_shared_cache_is_writer(void)
+{
+	return s_sharedCache.writer;
+}
+
+void p4_shared_cache_request_refresh(void)
+{
+	if(s_sharedCache.refreshEvent && !s_sharedCache.writer) {
+		SetEvent(s_sharedCache.refreshEvent);
+	}
+}
+
+b32 p4_shared_cache_refresh_requested(void)
+{
+	return s_sharedCache.writer && s_sharedCache.refreshEvent && WaitForSingleObject(s_sharedCache.refreshEvent, 0) == WAIT_OBJECT_0;
+}
+
+void p4_shared_cache_file_info(const char *path, u64 *writeTime, u64 *size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(GetFileAttributesExA(path, GetFileExInfoStandard, &data)) {
+		*writeTime = ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+		*size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	} else {
+		*writeTime = 0;
+		*size = 0;
+	}
+}
+
+void p4_shared_cache_shutdown(void)
+{
+	p4_shared_cache_release();
+}
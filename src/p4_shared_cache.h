@@ -0,0 +1,35 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "common.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Instances of p4t on the same machine share the changelist caches for a server and user.  Each
+// maps the same snapshot, so its columns are shared by the OS rather than copied per process.  One
+// instance - whichever holds a named mutex for the shard - is the writer: it fetches newer changes
+// from the server, appends them to the log and compacts it.  The others only read what the writer
+// leaves, and signal it when they want newer changes.  If the writer exits, the next instance to
+// call p4_shared_cache_elect takes over.
+
+// key identifies the shard (the caches' path without an extension).  Returns true if this
+// instance is the shard's writer.
+b32 p4_shared_cache_elect(const char *key);
+b32 p4_shared_cache_is_writer(void);
+
+// readers ask the writer for newer changes - the writer polls for requests
+void p4_shared_cache_request_refresh(void);
+b32 p4_shared_cache_refresh_requested(void);
+
+// last write time and size of a cache file, both 0 if it is missing
+void p4_shared_cache_file_info(const char *path, u64 *writeTime, u64 *size);
+
+void p4_shared_cache_shutdown(void);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -4,13 +4,178 @@
 #include "p4_task.h"
 #include "appdata.h"
 #include "bb_array.h"
+#include "config.h"
 #include "file_utils.h"
 #include "imgui_core.h"
 #include "message_box.h"
 #include "output.h"
+#include "p4.h"
+#include "p4_reactor.h"
+#include "p4_telemetry.h"
 #include "py_parser.h"
 #include "str.h"
 
+typedef struct tag_p4QueuedTasks {
+	u32 count;
+	u32 allocated;
+	task *data;
+} p4QueuedTasks;
+
+static p4QueuedTasks s_queuedTasks[kP4TaskPriority_Count];
+static u32 s_tasksInFlight[kP4TaskPriority_Count];
+BB_CTASSERT(BB_ARRAYSIZE(s_tasksInFlight) == BB_ARRAYSIZE(g_config.p4.maxTasksInFlight));
+
+// every p4 task queued through the scheduler has a request until it finishes.
+// identical requests (same normalized command line, statechanged callback and extraData) that are
+// queued or running share a single task.  The statechanged callbacks publish results into shared
+// p4 state (p4.changelists, p4.changesets, etc), so later callers see the same parsed result.
+// extraData is part of the key because the callback reads it - a request attached to another with
+// different extraData would have its own thrown away.
+typedef struct tag_p4Request {
+	sb_t key; // empty for batched requests, which aren't shared
+	p4ViewIds views;
+	u32 id;
+	u32 attachCount;
+	b32 pinned; // requested outside of any view
+	b32 canceled;
+} p4Request;
+
+typedef struct tag_p4Requests {
+	u32 count;
+	u32 allocated;
+	p4Request *data;
+} p4Requests;
+
+static p4Requests s_requests;
+static u32 s_lastRequestId;
+static p4ViewIds s_currentViews;
+
+void p4_view_ids_add(p4ViewIds *views, u32 viewId)
+{
+	for(u32 i = 0; i < views->count; ++i) {
+		if(views->data[i] == viewId) {
+			return;
+		}
+	}
+	bba_push(*views, viewId);
+}
+
+void p4_view_ids_add_all(p4ViewIds *views, const p4ViewIds *src)
+{
+	for(u32 i = 0; i < src->count; ++i) {
+		p4_view_ids_add(views, src->data[i]);
+	}
+}
+
+void p4_task_set_view(u32 viewId)
+{
+	s_currentViews.count = 0;
+	if(viewId) {
+		bba_push(s_currentViews, viewId);
+	}
+}
+
+const p4ViewIds *p4_task_current_views(void)
+{
+	return &s_currentViews;
+}
+
+static void p4_request_add_views(p4Request *request, const p4ViewIds *views)
+{
+	if(!views || !views->count) {
+		request->pinned = true;
+	}
+	for(u32 i = 0; views && i < views->count; ++i) {
+		if(views->data[i]) {
+			p4_view_ids_add(&request->views, views->data[i]);
+		} else {
+			request->pinned = true;
+		}
+	}
+}
+
+static sb_t p4_task_build_request_key(const task *t)
+{
+	task_p4 *p = t->taskData;
+	sb_t key = { 0 };
+	sb_va(&key, "%p ", (void *)t->stateChanged);
+	const char *cursor = sb_get(&p->base.cmdline);
+	b32 space = false;
+	while(*cursor) {
+		char ch = *cursor++;
+		if(ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n') {
+			space = key.count > 0;
+		} else {
+			if(space) {
+				sb_append_char(&key, ' ');
+				space = false;
+			}
+			sb_append_char(&key, ch);
+		}
+	}
+	for(u32 i = 0; i < p->extraData.count; ++i) {
+		const sdictEntry_t *entry = p->extraData.data + i;
+		sb_va(&key, "\n%s=%s", sb_get(&entry->key), sb_get(&entry->value));
+	}
+	return key;
+}
+
+static p4Request *p4_task_find_request(const char *key)
+{
+	for(u32 i = 0; i < s_requests.count; ++i) {
+		p4Request *request = s_requests.data + i;
+		if(!request->canceled && request->key.count && !strcmp(sb_get(&request->key), key)) {
+			return request;
+		}
+	}
+	return NULL;
+}
+
+static p4Request *p4_task_find_request_by_id(u32 id)
+{
+	for(u32 i = 0; id && i < s_requests.count; ++i) {
+		if(s_requests.data[i].id == id) {
+			return s_requests.data + i;
+		}
+	}
+	return NULL;
+}
+
+void p4_task_add_request_views(u32 requestId, const p4ViewIds *views)
+{
+	p4Request *request = p4_task_find_request_by_id(requestId);
+	if(request && !request->canceled) {
+		p4_request_add_views(request, views);
+	}
+}
+
+static void p4_task_release_request(task_p4 *t)
+{
+	p4Request *request = p4_task_find_request_by_id(t->requestId);
+	if(request) {
+		if(request->attachCount) {
+			BB_LOG("p4::dedupe", "finished %s - shared with %u other requests", sb_get(&request->key), request->attachCount);
+		}
+		sb_reset(&request->key);
+		bba_free(request->views);
+		bba_erase(s_requests, (u32)(request - s_requests.data));
+	}
+	t->requestId = 0;
+	sb_reset(&t->requestKey);
+}
+
+static void p4_task_set_in_flight(task_p4 *t, b32 inFlight)
+{
+	if(t->inFlight != inFlight && t->priority < kP4TaskPriority_Count) {
+		t->inFlight = inFlight;
+		if(inFlight) {
+			++s_tasksInFlight[t->priority];
+		} else {
+			--s_tasksInFlight[t->priority];
+		}
+	}
+}
+
 static void mb_error_report(const char *title, const char *text)
 {
 	messageBox mb = { 0 };
@@ -21,26 +186,167 @@ static void mb_error_report(const char *title, const char *text)
 	mb_queue(mb, NULL);
 }
 
-void task_p4_tick(task *_t)
+enum {
+	kParser_CompactThreshold = 64 * 1024,
+	kParser_ShrinkThreshold = 4 * 1024 * 1024,
+};
+
+// Drops marshal bytes the parser has already consumed, keeping only the unparsed tail, so a
+// long stream doesn't hold on to its raw bytes next to the parsed sdicts.
+void p4_parser_compact(pyParser *parser)
+{
+	if(parser->state == kParser_Error) {
+		return; // keep the data around for the postmortem in task_p4_reset
+	}
+	if(parser->cursor == parser->count) {
+		if(parser->allocated > kParser_ShrinkThreshold) {
+			bba_free(*parser);
+		}
+		parser->count = 0;
+		parser->cursor = 0;
+	} else if(parser->cursor >= kParser_CompactThreshold || parser->cursor * 2 >= parser->count) {
+		u32 remaining = parser->count - parser->cursor;
+		memmove(parser->data, parser->data + parser->cursor, remaining);
+		parser->count = remaining;
+		parser->cursor = 0;
+	}
+}
+
+// fallback when the reactor thread isn't running - reads and parses output on the main thread
+static b32 task_p4_pump(task_p4 *t)
 {
-	task_p4 *t = (task_p4 *)_t->taskData;
 	processTickResult_t res = process_tick(t->base.process);
 	if(res.stdoutIO.nBytes) {
 		Imgui_Core_RequestRender();
+		u64 parseStart = p4_telemetry_ticks();
+		u32 prevRecords = t->useRecords ? t->records.count : t->parsedDicts.count;
 		bba_add_array(t->parser, res.stdoutIO.buffer, res.stdoutIO.nBytes);
-		while(py_parser_tick(&t->parser, &t->parsedDicts, false)) {
-			// do nothing
+		if(t->useRecords) {
+			p4_parser_decode_records(&t->parser, &t->records);
+		} else {
+			while(py_parser_tick(&t->parser, &t->parsedDicts, false)) {
+				// do nothing
+			}
+		}
+		p4_parser_compact(&t->parser);
+
+		// the parser has its own copy of the unparsed bytes, so the process doesn't need to keep
+		// the whole stream around
+		if(t->base.process) {
+			t->base.process->stdoutBuffer.count = 0;
 		}
+		u32 records = (t->useRecords ? t->records.count : t->parsedDicts.count) - prevRecords;
+		p4_telemetry_output(t->telemetryId, res.stdoutIO.nBytes, records, p4_telemetry_ticks() - parseStart);
 	}
 	if(res.stderrIO.nBytes) {
 		Imgui_Core_RequestRender();
 		output_error("%.*s\n", res.stderrIO.nBytes, res.stderrIO.buffer);
 	}
-	if(res.done) {
+	return res.done;
+}
+
+static b32 task_p4_collect(task_p4 *t)
+{
+	sb_t stderrText = { 0 };
+	b32 done = p4_reactor_collect(t->reactorJob, &t->parsedDicts, &stderrText);
+	if(stderrText.count) {
+		output_error("%s", sb_get(&stderrText));
+	}
+	sb_reset(&stderrText);
+	if(done) {
+		p4_reactor_detach(t->reactorJob, &t->parser);
+		t->reactorJob = NULL;
+	}
+	return done;
+}
+
+// decodes the complete records in the parser's buffer, advancing its cursor
+void p4_parser_decode_records(pyParser *parser, p4Records *records)
+{
+	if(parser->state == kParser_Error) {
+		return;
+	}
+	u32 consumed = 0;
+	if(p4_records_parse(records, parser->data + parser->cursor, parser->count - parser->cursor, &consumed)) {
+		parser->cursor += consumed;
+	} else {
+		parser->cursor += consumed;
+		parser->state = kParser_Error;
+		BB_ERROR("p4::parser", "invalid marshal data at offset %u", parser->cursor);
+	}
+}
+
+// finishes a task whose views have all gone away, without waiting on (or parsing) the rest of its output
+static void task_p4_cancel(task *_t)
+{
+	task_p4 *t = (task_p4 *)_t->taskData;
+	BB_LOG("p4::cancel", "canceled %s - no views are waiting on it", sb_get(&_t->name));
+	if(t->reactorJob) {
+		p4_reactor_detach(t->reactorJob, &t->parser);
+		t->reactorJob = NULL;
+	}
+	if(t->base.process && !t->base.process->done) {
+		process_request_shutdown(t->base.process);
+	}
+	p4_task_set_in_flight(t, false);
+	p4_task_release_request(t);
+	p4_telemetry_done(t->telemetryId, kTaskState_Canceled);
+	task_set_state(_t, kTaskState_Canceled);
+}
+
+// tasks queued while the statechanged callback runs are follow-ups for the same views
+static void task_p4_finish(task *_t, taskState state)
+{
+	task_p4 *t = (task_p4 *)_t->taskData;
+	p4ViewIds prevViews = s_currentViews;
+	p4ViewIds views = { 0 };
+	p4Request *request = p4_task_find_request_by_id(t->requestId);
+	if(request && !request->pinned) {
+		p4_view_ids_add_all(&views, &request->views);
+	}
+	p4_task_release_request(t);
+	p4_telemetry_done(t->telemetryId, state);
+	s_currentViews = views;
+	u64 callbackStart = p4_telemetry_ticks();
+	task_set_state(_t, state);
+	p4_telemetry_callback(t->telemetryId, p4_telemetry_ticks() - callbackStart);
+	bba_free(s_currentViews);
+	s_currentViews = prevViews;
+}
+
+void task_p4_tick(task *_t)
+{
+	task_p4 *t = (task_p4 *)_t->taskData;
+	if(!task_done(_t)) {
+		p4Request *request = p4_task_find_request_by_id(t->requestId);
+		if(request && request->canceled) {
+			task_p4_cancel(_t);
+			task_tick_subtasks(_t);
+			return;
+		}
+		p4_task_set_in_flight(t, true);
+	}
+	if(t->base.process && !t->spawned) {
+		// task_queue only queues the task - the process is created when it first runs
+		t->spawned = true;
+		p4_telemetry_spawned(t->telemetryId);
+	}
+	if(!t->reactorJob && !task_done(_t)) {
+		t->reactorJob = p4_reactor_attach(t->base.process, t->useRecords ? &t->records : NULL, t->telemetryId);
+	}
+	b32 done = (t->reactorJob) ? task_p4_collect(t) : task_p4_pump(t);
+	if(done) {
 		taskState state = kTaskState_Succeeded;
 		if(t->base.process && t->base.process->stderrBuffer.count) {
 			state = kTaskState_Failed;
 			mb_error_report("p4 error", t->base.process->stderrBuffer.data);
+		} else if(t->batched) {
+			for(u32 i = 0; i < t->parsedDicts.count; ++i) {
+				sdict_t *sd = t->parsedDicts.data + i;
+				if(!strcmp(sdict_find_safe(sd, "code"), "error")) {
+					output_error("%s", sdict_find_safe(sd, "data"));
+				}
+			}
 		} else if(t->parsedDicts.count) {
 			sdict_t *sd = t->parsedDicts.data;
 			if(!strcmp(sdict_find_safe(sd, "code"), "error")) {
@@ -49,8 +355,16 @@ void task_p4_tick(task *_t)
 					mb_error_report("p4 error", sdict_find_safe(sd, "data"));
 				}
 			}
+		} else if(t->records.count) {
+			if(!strcmp(p4_record_find_safe(&t->records, 0, "code"), "error")) {
+				state = kTaskState_Failed;
+				if(strtou32(p4_record_find_safe(&t->records, 0, "severity")) > 2) {
+					mb_error_report("p4 error", p4_record_find_safe(&t->records, 0, "data"));
+				}
+			}
 		}
-		task_set_state(_t, state);
+		p4_task_set_in_flight(t, false);
+		task_p4_finish(_t, state);
 	}
 	task_tick_subtasks(_t);
 }
@@ -58,7 +372,14 @@ void task_p4_tick(task *_t)
 void task_p4_reset(task *_t)
 {
 	task_p4 *t = (task_p4 *)_t->taskData;
+	if(t->reactorJob) {
+		p4_reactor_detach(t->reactorJob, &t->parser);
+		t->reactorJob = NULL;
+	}
+	p4_task_set_in_flight(t, false);
+	p4_task_release_request(t);
 	sdicts_reset(&t->parsedDicts);
+	p4_records_reset(&t->records);
 	if(t->parser.state == kParser_Error) {
 		sb_t path = appdata_get("p4t");
 		sb_append(&path, "\\p4_error.bin");
@@ -66,7 +387,7 @@ void task_p4_reset(task *_t)
 		fd.buffer = t->parser.data;
 		fd.bufferSize = t->parser.count;
 		if(fd.buffer && path.data) {
-			BB_LOG("p4::parser::postmortem", "begin save err data - path:%s", sb_get(&path));
+			BB_LOG("p4::parser::postmortem", "begin save err data (unparsed tail of the stream) - path:%s", sb_get(&path));
 			BB_FLUSH();
 			b32 wrote = fileData_writeIfChanged(path.data, NULL, fd);
 			if(wrote) {
@@ -80,6 +401,10 @@ void task_p4_reset(task *_t)
 	bba_free(t->parser);
 	sdict_reset(&t->parser.dict);
 	sdict_reset(&t->extraData);
+	if(t->batchPath.count) {
+		file_delete(sb_get(&t->batchPath));
+		sb_reset(&t->batchPath);
+	}
 	task_process_reset(_t);
 }
 
@@ -104,6 +429,247 @@ task p4_task_create(const char *name, Task_StateChanged *statechanged, const cha
 		sb_va_list(&p->base.cmdline, cmdlineFmt, args);
 		va_end(args);
 		p->base.spawnType = kProcessSpawn_Tracked;
+		p->priority = kP4TaskPriority_Count;
 	}
 	return t;
 }
+
+task p4_task_create_batch(const char *name, Task_StateChanged *statechanged, const char *dir, sdict_t *extraData, const sbs_t *batchArgs, const char *commandFmt, ...)
+{
+	static u32 s_batchCount;
+	task t = p4_task_create(name, statechanged, dir, extraData, "");
+	task_p4 *p = t.taskData;
+	if(p) {
+		sb_t contents = { 0 };
+		for(u32 i = 0; i < batchArgs->count; ++i) {
+			sb_append(&contents, sb_get(batchArgs->data + i));
+			sb_append_char(&contents, '\n');
+		}
+		p->batchPath = appdata_get("p4t");
+		sb_va(&p->batchPath, "\\p4t_batch_%u_%u.txt", GetCurrentProcessId(), ++s_batchCount);
+		fileData_t fd = { 0 };
+		fd.buffer = contents.data;
+		fd.bufferSize = sb_len(&contents);
+		if(fd.buffer && fileData_write(sb_get(&p->batchPath), NULL, fd)) {
+			BB_LOG("p4::batch", "%s - %u args - path:%s", name, batchArgs->count, sb_get(&p->batchPath));
+		} else {
+			BB_ERROR("p4::batch", "%s - failed to write %u args - path:%s", name, batchArgs->count, sb_get(&p->batchPath));
+		}
+		sb_reset(&contents);
+
+		p->batched = true;
+		sb_reset(&p->base.cmdline);
+		sb_va(&p->base.cmdline, "\"%s\" -G -x \"%s\" ", p4_exe(), sb_get(&p->batchPath));
+		va_list args;
+		va_start(args, commandFmt);
+		sb_va_list(&p->base.cmdline, commandFmt, args);
+		va_end(args);
+	}
+	return t;
+}
+
+void p4_task_set_dropped(task *t, p4Task_Dropped *dropped)
+{
+	if(t->tick == task_p4_tick && t->taskData) {
+		task_p4 *p = t->taskData;
+		p->dropped = dropped;
+	}
+}
+
+void p4_task_use_records(task *t)
+{
+	if(t->tick == task_p4_tick && t->taskData) {
+		task_p4 *p = t->taskData;
+		p->useRecords = true;
+	}
+}
+
+static void p4_task_set_priority(task *t, p4TaskPriority priority)
+{
+	if(t->tick == task_p4_tick && t->taskData) {
+		task_p4 *p = t->taskData;
+		p->priority = priority;
+	}
+	for(u32 i = 0; i < t->subtasks.count; ++i) {
+		p4_task_set_priority(t->subtasks.data + i, priority);
+	}
+}
+
+static void p4_task_discard(task *t)
+{
+	if(t->reset && t->taskData) {
+		t->reset(t);
+	}
+	for(u32 i = 0; i < t->subtasks.count; ++i) {
+		p4_task_discard(t->subtasks.data + i);
+	}
+	bba_free(t->subtasks);
+	sdict_reset(&t->extraData);
+	sb_reset(&t->name);
+}
+
+static void p4_task_promote_queued_request(u32 requestId, p4TaskPriority priority)
+{
+	for(u32 queueIndex = priority + 1; queueIndex < kP4TaskPriority_Count; ++queueIndex) {
+		p4QueuedTasks *queued = s_queuedTasks + queueIndex;
+		for(u32 i = 0; i < queued->count; ++i) {
+			task_p4 *p = queued->data[i].taskData;
+			if(p && p->requestId == requestId) {
+				task t = queued->data[i];
+				memmove(queued->data + i, queued->data + i + 1, (queued->count - i - 1) * sizeof(task));
+				--queued->count;
+				p4_task_set_priority(&t, priority);
+				bba_push(s_queuedTasks[priority], t);
+				return;
+			}
+		}
+	}
+}
+
+p4TaskQueueResult p4_task_queue(p4TaskPriority priority, task t)
+{
+	return p4_task_queue_for_views(priority, t, &s_currentViews);
+}
+
+p4TaskQueueResult p4_task_queue_for_views(p4TaskPriority priority, task t, const p4ViewIds *views)
+{
+	if(!t.taskData && !t.subtasks.count) {
+		p4_task_discard(&t);
+		return kP4TaskQueue_Failed;
+	}
+	priority = BB_MIN(priority, kP4TaskPriority_Background);
+	p4_task_set_priority(&t, priority);
+	if(t.tick != task_p4_tick) {
+		// composite tasks (diffs) start right away - their p4 subtasks still count against the limit
+		return task_queue(t) ? kP4TaskQueue_Queued : kP4TaskQueue_Failed;
+	}
+
+	task_p4 *p = t.taskData;
+	sb_t key = { 0 };
+	if(!p->batched) {
+		key = p4_task_build_request_key(&t);
+		p4Request *request = p4_task_find_request(sb_get(&key));
+		if(request) {
+			++request->attachCount;
+			p4_request_add_views(request, views);
+			BB_LOG("p4::dedupe", "attached %s to existing request (%u attached)", sb_get(&t.name), request->attachCount);
+			p4_task_promote_queued_request(request->id, priority);
+			sb_reset(&key);
+			p4_task_discard(&t);
+			p4_task_scheduler_tick();
+			return kP4TaskQueue_Attached;
+		}
+	}
+	p4Request newRequest = { 0 };
+	newRequest.key = sb_clone(&key);
+	newRequest.id = ++s_lastRequestId;
+	p4_request_add_views(&newRequest, views);
+	bba_push(s_requests, newRequest);
+	p->requestId = newRequest.id;
+	p->requestKey = key;
+	p->telemetryId = p4_telemetry_begin(sb_get(&t.name), sb_get(&p->base.cmdline), priority);
+
+	bba_push(s_queuedTasks[priority], t);
+	p4_task_scheduler_tick();
+	return kP4TaskQueue_Queued;
+}
+
+void p4_task_scheduler_tick(void)
+{
+	for(u32 priority = 0; priority < kP4TaskPriority_Count; ++priority) {
+		p4QueuedTasks *queued = s_queuedTasks + priority;
+		u32 maxInFlight = g_config.p4.maxTasksInFlight[priority];
+		u32 started = 0;
+		while(started < queued->count && (!maxInFlight || s_tasksInFlight[priority] < maxInFlight)) {
+			task t = queued->data[started++];
+			task_p4 *p = t.taskData;
+			BB_LOG("p4::scheduler", "start %s - priority:%u inFlight:%u queued:%u", sb_get(&t.name), priority, s_tasksInFlight[priority], queued->count - started);
+			u32 telemetryId = p ? p->telemetryId : 0;
+			p4_telemetry_started(telemetryId);
+			task *queuedTask = task_queue(t);
+			if(queuedTask && p) {
+				p4_task_set_in_flight(queuedTask->taskData, true);
+			} else {
+				p4_telemetry_done(telemetryId, kTaskState_Failed);
+			}
+		}
+		if(started) {
+			memmove(queued->data, queued->data + started, (queued->count - started) * sizeof(task));
+			queued->count -= started;
+		}
+	}
+}
+
+void p4_task_scheduler_shutdown(void)
+{
+	for(u32 priority = 0; priority < kP4TaskPriority_Count; ++priority) {
+		p4QueuedTasks *queued = s_queuedTasks + priority;
+		for(u32 i = 0; i < queued->count; ++i) {
+			p4_task_discard(queued->data + i);
+		}
+		bba_free(*queued);
+	}
+	for(u32 i = 0; i < s_requests.count; ++i) {
+		sb_reset(&s_requests.data[i].key);
+		bba_free(s_requests.data[i].views);
+	}
+	bba_free(s_requests);
+	bba_free(s_currentViews);
+}
+
+static b32 p4_task_cancel_queued_request(u32 requestId)
+{
+	for(u32 priority = 0; priority < kP4TaskPriority_Count; ++priority) {
+		p4QueuedTasks *queued = s_queuedTasks + priority;
+		for(u32 i = 0; i < queued->count; ++i) {
+			task_p4 *p = queued->data[i].taskData;
+			if(p && p->requestId == requestId) {
+				task t = queued->data[i];
+				bba_erase(*queued, i);
+				BB_LOG("p4::cancel", "dropped queued %s - no views are waiting on it", sb_get(&t.name));
+				p4_task_release_request(p);
+				p4_telemetry_done(p->telemetryId, kTaskState_Canceled);
+				if(p->dropped) {
+					p->dropped(p);
+				}
+				p4_task_discard(&t);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void p4_task_release_view(u32 viewId)
+{
+	if(!viewId) {
+		return;
+	}
+	for(u32 i = 0; i < s_requests.count;) {
+		p4Request *request = s_requests.data + i;
+		u32 prevCount = request->views.count;
+		for(u32 j = 0; j < request->views.count; ++j) {
+			if(request->views.data[j] == viewId) {
+				bba_erase(request->views, j);
+				break;
+			}
+		}
+		if(prevCount && !request->views.count && !request->pinned && !request->canceled) {
+			request->canceled = true;
+			if(p4_task_cancel_queued_request(request->id)) {
+				continue; // the request was erased - the next one moved into slot i
+			}
+		}
+		++i;
+	}
+}
+
+u32 p4_task_scheduler_queued_count(p4TaskPriority priority)
+{
+	return (priority < kP4TaskPriority_Count) ? s_queuedTasks[priority].count : 0;
+}
+
+u32 p4_task_scheduler_in_flight_count(p4TaskPriority priority)
+{
+	return (priority < kP4TaskPriority_Count) ? s_tasksInFlight[priority] : 0;
+}
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "p4_records.h"
 #include "process_task.h"
 #include "sdict.h"
 #include "py_parser.h"
@@ -11,17 +12,97 @@
 extern "C" {
 #endif
 
+typedef enum tag_p4TaskPriority {
+	kP4TaskPriority_Interactive, // diffs and other direct user actions
+	kP4TaskPriority_Visible,     // describes for rows/tabs on screen, refreshing the visible changeset
+	kP4TaskPriority_Prefetch,    // describes for tabs that aren't visible yet
+	kP4TaskPriority_Background,  // history backfill
+	kP4TaskPriority_Count
+} p4TaskPriority;
+
+// ids of the views (changeset and changelist tabs) waiting on a request.  0 stands for a request
+// made outside of any view, which is never canceled.
+typedef struct tag_p4ViewIds {
+	u32 count;
+	u32 allocated;
+	u32 *data;
+} p4ViewIds;
+
+struct tag_task_p4;
+// see p4_task_set_dropped
+typedef void p4Task_Dropped(struct tag_task_p4 *p);
+
 typedef struct tag_task_p4 {
 	task_process base;
 	sdicts parsedDicts;
 	pyParser parser;
 	sdict_t extraData;
+	sb_t batchPath;
+	b32 batched;
+	p4TaskPriority priority;
+	b32 inFlight;
+	b32 useRecords;
+	u32 requestId;
+	u32 telemetryId;
+	b32 spawned; // the process has been created and reported to telemetry
+	u8 pad[4];
+	sb_t requestKey;
+	p4Task_Dropped *dropped;
+	struct tag_p4ReactorJob *reactorJob; // output is read and parsed on the reactor thread
+	p4Records records;                   // output goes here instead of parsedDicts if useRecords
 } task_p4;
 
+typedef enum tag_p4TaskQueueResult {
+	kP4TaskQueue_Failed,
+	kP4TaskQueue_Queued,
+	kP4TaskQueue_Attached, // an identical request was already queued or running
+} p4TaskQueueResult;
+
 void task_p4_tick(task *);
+void p4_parser_compact(pyParser *parser);
+void p4_parser_decode_records(pyParser *parser, p4Records *records);
 void task_p4_reset(task *);
 task p4_task_create(const char *name, Task_StateChanged *statechanged, const char *dir, sdict_t *extraData, const char *cmdlineFmt, ...);
 
+// decode output into task_p4::records instead of parsedDicts - for large results (changes) that
+// are kept around, so they don't cost an allocation per key and value
+void p4_task_use_records(task *t);
+
+// A task dropped from the queue before it starts (see p4_task_release_view) is freed without
+// calling its statechanged callback, since it never had a process or output.  dropped is called
+// instead, so the caller can undo whatever it set up when queueing (in-flight flags and the like).
+void p4_task_set_dropped(task *t, p4Task_Dropped *dropped);
+
+// runs one p4 process for many arguments (p4 -x), e.g. "describe -s" for a list of changelists.
+// errors for individual arguments don't fail the task - the statechanged callback gets every
+// record and is responsible for splitting them back out (typically by the "change" key).
+task p4_task_create_batch(const char *name, Task_StateChanged *statechanged, const char *dir, sdict_t *extraData, const sbs_t *batchArgs, const char *commandFmt, ...);
+
+// p4 tasks should be queued through the scheduler rather than task_queue, so the number of
+// p4 processes running at once is limited per priority (g_config.p4.maxTasksInFlight).
+// extraData has to be passed to p4_task_create since the task might not start right away.
+// Identical requests (same command line, statechanged callback and extraData) are deduplicated -
+// see p4TaskQueueResult.
+p4TaskQueueResult p4_task_queue(p4TaskPriority priority, task t);
+
+// Requests are linked to the views that asked for them.  p4_task_queue uses the current view set by
+// p4_task_set_view (0 when not on behalf of a view).  Tasks queued from a statechanged callback
+// inherit the views of the task that finished.  When the last view of a request is released, a
+// queued task is dropped (see p4_task_set_dropped) and a running one has its p4 process shut down
+// and finishes as kTaskState_Canceled.
+p4TaskQueueResult p4_task_queue_for_views(p4TaskPriority priority, task t, const p4ViewIds *views);
+void p4_task_set_view(u32 viewId);
+const p4ViewIds *p4_task_current_views(void);
+void p4_task_release_view(u32 viewId);
+void p4_task_add_request_views(u32 requestId, const p4ViewIds *views); // task_p4::requestId
+void p4_view_ids_add(p4ViewIds *views, u32 viewId);
+void p4_view_ids_add_all(p4ViewIds *views, const p4ViewIds *src);
+
+void p4_task_scheduler_tick(void);
+void p4_task_scheduler_shutdown(void);
+u32 p4_task_scheduler_queued_count(p4TaskPriority priority);
+u32 p4_task_scheduler_in_flight_count(p4TaskPriority priority);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,267 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "p4_telemetry.h"
+#include "bb_criticalsection.h"
+#include "file_utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct tag_p4Telemetry {
+	bb_critical_section cs;
+	p4TaskMetrics entries[kP4Telemetry_MaxEntries]; // ring buffer indexed by (id - 1)
+	u32 lastId;
+	b32 initialized;
+	u64 frequency;
+	u64 baseTicks;
+} p4Telemetry;
+
+static p4Telemetry s_telemetry;
+
+u64 p4_telemetry_ticks(void)
+{
+	LARGE_INTEGER li;
+	QueryPerformanceCounter(&li);
+	return (u64)li.QuadPart;
+}
+
+double p4_telemetry_ms(u64 ticks)
+{
+	return s_telemetry.frequency ? (double)ticks * 1000.0 / (double)s_telemetry.frequency : 0.0;
+}
+
+void p4_telemetry_startup(void)
+{
+	if(!s_telemetry.initialized) {
+		LARGE_INTEGER li;
+		QueryPerformanceFrequency(&li);
+		s_telemetry.frequency = (u64)li.QuadPart;
+		s_telemetry.baseTicks = p4_telemetry_ticks();
+		bb_critical_section_init(&s_telemetry.cs);
+		s_telemetry.initialized = true;
+	}
+}
+
+void p4_telemetry_shutdown(void)
+{
+	if(s_telemetry.initialized) {
+		bb_critical_section_shutdown(&s_telemetry.cs);
+		s_telemetry.initialized = false;
+	}
+}
+
+// called with the lock held
+static p4TaskMetrics *p4_telemetry_find(u32 id)
+{
+	if(!id) {
+		return NULL;
+	}
+	p4TaskMetrics *entry = s_telemetry.entries + (id - 1) % kP4Telemetry_MaxEntries;
+	return (entry->id == id) ? entry : NULL; // NULL once the ring has wrapped around it
+}
+
+static void p4_telemetry_copy_string(char *dst, size_t dstSize, const char *src)
+{
+	size_t len = strlen(src);
+	if(len >= dstSize) {
+		len = dstSize - 1;
+	}
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+u32 p4_telemetry_begin(const char *name, const char *command, u32 priority)
+{
+	if(!s_telemetry.initialized) {
+		return 0;
+	}
+	u64 now = p4_telemetry_ticks();
+	bb_critical_section_lock(&s_telemetry.cs);
+	u32 id = ++s_telemetry.lastId;
+	p4TaskMetrics *entry = s_telemetry.entries + (id - 1) % kP4Telemetry_MaxEntries;
+	memset(entry, 0, sizeof(*entry));
+	entry->id = id;
+	entry->priority = priority;
+	entry->queuedTicks = now;
+	p4_telemetry_copy_string(entry->name, sizeof(entry->name), name);
+	p4_telemetry_copy_string(entry->command, sizeof(entry->command), command);
+	bb_critical_section_unlock(&s_telemetry.cs);
+	return id;
+}
+
+void p4_telemetry_started(u32 id)
+{
+	if(id) {
+		u64 now = p4_telemetry_ticks();
+		bb_critical_section_lock(&s_telemetry.cs);
+		p4TaskMetrics *entry = p4_telemetry_find(id);
+		if(entry) {
+			entry->startTicks = now;
+		}
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+}
+
+void p4_telemetry_spawned(u32 id)
+{
+	if(id) {
+		u64 now = p4_telemetry_ticks();
+		bb_critical_section_lock(&s_telemetry.cs);
+		p4TaskMetrics *entry = p4_telemetry_find(id);
+		if(entry) {
+			entry->spawnedTicks = now;
+		}
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+}
+
+void p4_telemetry_output(u32 id, u32 bytes, u32 records, u64 parseTicks)
+{
+	if(id) {
+		u64 now = p4_telemetry_ticks();
+		bb_critical_section_lock(&s_telemetry.cs);
+		p4TaskMetrics *entry = p4_telemetry_find(id);
+		if(entry) {
+			if(bytes && !entry->firstByteTicks) {
+				entry->firstByteTicks = now;
+			}
+			entry->bytes += bytes;
+			entry->records += records;
+			entry->parseTicks += parseTicks;
+		}
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+}
+
+void p4_telemetry_callback(u32 id, u64 callbackTicks)
+{
+	if(id) {
+		bb_critical_section_lock(&s_telemetry.cs);
+		p4TaskMetrics *entry = p4_telemetry_find(id);
+		if(entry) {
+			entry->callbackTicks += callbackTicks;
+		}
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+}
+
+void p4_telemetry_done(u32 id, u32 state)
+{
+	if(id) {
+		u64 now = p4_telemetry_ticks();
+		bb_critical_section_lock(&s_telemetry.cs);
+		p4TaskMetrics *entry = p4_telemetry_find(id);
+		if(entry && !entry->doneTicks) {
+			entry->doneTicks = now;
+			entry->state = state;
+		}
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+}
+
+u32 p4_telemetry_snapshot(p4TaskMetrics *entries, u32 maxEntries)
+{
+	u32 count = 0;
+	if(s_telemetry.initialized) {
+		bb_critical_section_lock(&s_telemetry.cs);
+		u32 lastId = s_telemetry.lastId;
+		u32 available = BB_MIN(lastId, (u32)kP4Telemetry_MaxEntries);
+		u32 numEntries = BB_MIN(available, maxEntries);
+		for(u32 id = lastId - numEntries + 1; id <= lastId; ++id) {
+			const p4TaskMetrics *entry = p4_telemetry_find(id);
+			if(entry) {
+				entries[count++] = *entry;
+			}
+		}
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+	return count;
+}
+
+void p4_telemetry_clear(void)
+{
+	if(s_telemetry.initialized) {
+		bb_critical_section_lock(&s_telemetry.cs);
+		memset(s_telemetry.entries, 0, sizeof(s_telemetry.entries));
+		bb_critical_section_unlock(&s_telemetry.cs);
+	}
+}
+
+static void p4_telemetry_append_json_string(sb_t *sb, const char *str)
+{
+	sb_append_char(sb, '"');
+	for(const char *c = str; *c; ++c) {
+		if(*c == '"' || *c == '\\') {
+			sb_append_char(sb, '\\');
+			sb_append_char(sb, *c);
+		} else if((u8)*c < 0x20) {
+			sb_va(sb, "\\u%04x", (u8)*c);
+		} else {
+			sb_append_char(sb, *c);
+		}
+	}
+	sb_append_char(sb, '"');
+}
+
+static double p4_telemetry_us(u64 ticks)
+{
+	return p4_telemetry_ms(ticks - s_telemetry.baseTicks) * 1000.0;
+}
+
+// one complete ("X") event per phase, all on the task's own row
+static void p4_telemetry_append_phase(sb_t *sb, const p4TaskMetrics *entry, const char *phase, u64 start, u64 end, b32 *first)
+{
+	if(!start || end < start) {
+		return;
+	}
+	sb_append(sb, *first ? "\n" : ",\n");
+	*first = false;
+	sb_append(sb, "{\"name\":");
+	p4_telemetry_append_json_string(sb, phase);
+	sb_append(sb, ",\"cat\":");
+	p4_telemetry_append_json_string(sb, entry->name);
+	sb_va(sb, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"command\":",
+	      entry->id, p4_telemetry_us(start), p4_telemetry_ms(end - start) * 1000.0);
+	p4_telemetry_append_json_string(sb, entry->command);
+	sb_va(sb, ",\"priority\":%u,\"state\":%u,\"bytes\":%llu,\"records\":%u,\"parseMs\":%.3f,\"callbackMs\":%.3f}}",
+	      entry->priority, entry->state, entry->bytes, entry->records,
+	      p4_telemetry_ms(entry->parseTicks), p4_telemetry_ms(entry->callbackTicks));
+}
+
+b32 p4_telemetry_write_chrome_trace(const char *path)
+{
+	p4TaskMetrics *entries = malloc(sizeof(p4TaskMetrics) * kP4Telemetry_MaxEntries);
+	if(!entries) {
+		return false;
+	}
+	u32 count = p4_telemetry_snapshot(entries, kP4Telemetry_MaxEntries);
+	u64 now = p4_telemetry_ticks();
+	sb_t sb = { 0 };
+	sb_append(&sb, "{\"traceEvents\":[");
+	b32 first = true;
+	for(u32 i = 0; i < count; ++i) {
+		const p4TaskMetrics *entry = entries + i;
+		u64 end = entry->doneTicks ? entry->doneTicks : now;
+		u64 spawned = entry->spawnedTicks ? entry->spawnedTicks : entry->startTicks;
+		p4_telemetry_append_phase(&sb, entry, entry->name, entry->queuedTicks, end, &first);
+		p4_telemetry_append_phase(&sb, entry, "queued", entry->queuedTicks, entry->startTicks ? entry->startTicks : end, &first);
+		p4_telemetry_append_phase(&sb, entry, "spawn", entry->startTicks, entry->spawnedTicks, &first);
+		p4_telemetry_append_phase(&sb, entry, "first byte", spawned, entry->firstByteTicks ? entry->firstByteTicks : end, &first);
+		p4_telemetry_append_phase(&sb, entry, "output", entry->firstByteTicks, end, &first);
+	}
+	sb_append(&sb, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	free(entries);
+
+	fileData_t fd = { 0 };
+	fd.buffer = sb.data;
+	fd.bufferSize = sb_len(&sb);
+	b32 wrote = fd.buffer && fileData_write(path, NULL, fd);
+	if(wrote) {
+		BB_LOG("p4::telemetry", "wrote %u tasks to %s", count, path);
+	} else {
+		BB_ERROR("p4::telemetry", "failed to write %u tasks to %s", count, path);
+	}
+	sb_reset(&sb);
+	return wrote;
+}
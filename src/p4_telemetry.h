@@ -0,0 +1,62 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "common.h"
+#include "sb.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Timing and throughput for each p4 command and thread task: when it was queued, started, spawned,
+// got its first byte and finished, how much output it read and decoded, and how long parsing and
+// the statechanged callback took.  The most recent kP4Telemetry_MaxEntries are kept, and can be
+// exported as a chrome://tracing JSON file.
+// Reporting is thread-safe, so the reactor and worker threads report directly.
+
+enum {
+	kP4Telemetry_MaxEntries = 1024,
+};
+
+typedef struct tag_p4TaskMetrics {
+	char name[64];
+	char command[192];
+	u32 id; // 0 for an unused entry
+	u32 priority;
+	u32 state; // taskState once done
+	u32 records;
+	u64 bytes;
+	u64 queuedTicks;
+	u64 startTicks;   // handed to the task system
+	u64 spawnedTicks; // process created (or thread started)
+	u64 firstByteTicks;
+	u64 doneTicks;
+	u64 parseTicks; // time spent decoding output, on whichever thread did it
+	u64 callbackTicks;
+} p4TaskMetrics;
+
+void p4_telemetry_startup(void);
+void p4_telemetry_shutdown(void);
+
+u64 p4_telemetry_ticks(void);
+double p4_telemetry_ms(u64 ticks);
+
+// returns an id for the other calls, or 0 if telemetry isn't running (which the other calls ignore)
+u32 p4_telemetry_begin(const char *name, const char *command, u32 priority);
+void p4_telemetry_started(u32 id);
+void p4_telemetry_spawned(u32 id);
+void p4_telemetry_output(u32 id, u32 bytes, u32 records, u64 parseTicks);
+void p4_telemetry_callback(u32 id, u64 callbackTicks);
+void p4_telemetry_done(u32 id, u32 state);
+
+// copies out entries, oldest first - returns the number copied
+u32 p4_telemetry_snapshot(p4TaskMetrics *entries, u32 maxEntries);
+void p4_telemetry_clear(void);
+
+b32 p4_telemetry_write_chrome_trace(const char *path);
+
+#if defined(__cplusplus)
+}
+#endif
@@ -146,9 +146,10 @@ p4Config json_deserialize_p4Config(JSON_Value *src)
 		if(obj) {
 			dst.clientspec = json_deserialize_sb_t(json_object_get_value(obj, "clientspec"));
 			dst.changelistBlockSize = (u32)json_object_get_number(obj, "changelistBlockSize");
-			for(u32 i = 0; i < BB_ARRAYSIZE(dst.pad); ++i) {
-				dst.pad[i] = (u8)json_object_get_number(obj, va("pad.%u", i));
+			for(u32 i = 0; i < BB_ARRAYSIZE(dst.maxTasksInFlight); ++i) {
+				dst.maxTasksInFlight[i] = (u32)json_object_get_number(obj, va("maxTasksInFlight.%u", i));
 			}
+			dst.blobCacheMaxMB = (u32)json_object_get_number(obj, "blobCacheMaxMB");
 		}
 	}
 	return dst;
@@ -413,9 +414,10 @@ JSON_Value *json_serialize_p4Config(const p4Config *src)
 	if(obj) {
 		json_object_set_value(obj, "clientspec", json_serialize_sb_t(&src->clientspec));
 		json_object_set_number(obj, "changelistBlockSize", src->changelistBlockSize);
-		for(u32 i = 0; i < BB_ARRAYSIZE(src->pad); ++i) {
-			json_object_set_number(obj, va("pad.%u", i), src->pad[i]);
+		for(u32 i = 0; i < BB_ARRAYSIZE(src->maxTasksInFlight); ++i) {
+			json_object_set_number(obj, va("maxTasksInFlight.%u", i), src->maxTasksInFlight[i]);
 		}
+		json_object_set_number(obj, "blobCacheMaxMB", src->blobCacheMaxMB);
 	}
 	return val;
 }
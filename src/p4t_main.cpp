@@ -12,6 +12,9 @@
 #include "message_box.h"
 #include "output.h"
 #include "p4.h"
+#include "p4_intern.h"
+#include "p4_reactor.h"
+#include "p4_telemetry.h"
 #include "p4t_update.h"
 #include "process_utils.h"
 #include "sb.h"
@@ -68,6 +71,9 @@ int CALLBACK WinMain(_In_ HINSTANCE /*Instance*/, _In_opt_ HINSTANCE /*PrevInsta
 
 	tasks_startup();
 	process_init();
+	p4_intern_startup();
+	p4_telemetry_startup();
+	p4_reactor_startup();
 	p4_init();
 
 	UITabs_LoadConfig();
@@ -99,6 +105,9 @@ int CALLBACK WinMain(_In_ HINSTANCE /*Instance*/, _In_opt_ HINSTANCE /*PrevInsta
 	UIChangelist_Shutdown();
 	p4_shutdown();
 	tasks_shutdown();
+	p4_reactor_shutdown();
+	p4_intern_shutdown();
+	p4_telemetry_shutdown();
 	UIConfig_Reset();
 	config_write(&g_config);
 	config_reset(&g_config);
@@ -163,9 +163,10 @@ p4Config p4Config_clone(const p4Config *src)
 	if(src) {
 		dst.clientspec = sb_clone(&src->clientspec);
 		dst.changelistBlockSize = src->changelistBlockSize;
-		for(u32 i = 0; i < BB_ARRAYSIZE(src->pad); ++i) {
-			dst.pad[i] = src->pad[i];
+		for(u32 i = 0; i < BB_ARRAYSIZE(src->maxTasksInFlight); ++i) {
+			dst.maxTasksInFlight[i] = src->maxTasksInFlight[i];
 		}
+		dst.blobCacheMaxMB = src->blobCacheMaxMB;
 	}
 	return dst;
 }
@@ -19,6 +19,7 @@
 #include "ui_message_box.h"
 #include "ui_output.h"
 #include "ui_tabs.h"
+#include "ui_telemetry.h"
 #include "va.h"
 
 static bool s_showImguiDemo;
@@ -91,6 +92,7 @@ static void p4t_menubar(void)
 					UITabs_SetRedockAll();
 				}
 				UIChangeset_Menu();
+				UITelemetry_Menu();
 				if(ImGui::BeginMenu("Imgui Help")) {
 					ImGui::MenuItem("Demo", nullptr, &s_showImguiDemo);
 					ImGui::MenuItem("About", nullptr, &s_showImguiAbout);
@@ -131,6 +133,7 @@ void p4t_update(void)
 	if(s_showImguiStyleEditor) {
 		ImGui::ShowStyleEditor();
 	}
+	UITelemetry_Update();
 
 	ImGuiIO &io = ImGui::GetIO();
 	ImGuiStyle &style = ImGui::GetStyle();
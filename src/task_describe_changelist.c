@@ -5,15 +5,176 @@
 
 #include "bb_array.h"
 #include "p4.h"
+#include "p4_describe_store.h"
 #include "p4_task.h"
 #include "str.h"
+#include "tokenize.h"
 #include "va.h"
 
 static u32 s_taskDescribeChangelistCount;
 
+typedef struct tag_p4ChangeNumbers {
+	u32 count;
+	u32 allocated;
+	u32 *data;
+} p4ChangeNumbers;
+
+typedef struct tag_p4InFlightChange {
+	u32 number;
+	u32 requestId;
+} p4InFlightChange;
+
+typedef struct tag_p4InFlightChanges {
+	u32 count;
+	u32 allocated;
+	p4InFlightChange *data;
+} p4InFlightChanges;
+
+// describes requested during a frame are gathered here and flushed as a few batched p4 processes.
+// changelists already being described aren't requested again - the running describe updates
+// p4.changelists for every view that asked for it, so those views are added to its request.
+// The batches for a priority are linked to every view that queued a describe there that frame.
+typedef struct tag_p4DescribeQueue {
+	p4ChangeNumbers queued[kP4TaskPriority_Count];
+	p4ViewIds views[kP4TaskPriority_Count];
+	p4InFlightChanges inFlight;
+} p4DescribeQueue;
+
+static p4DescribeQueue s_describes;
+static p4DescribeQueue s_shelvedDescribes;
+
+enum {
+	kDescribeBatch_MinArgsPerProcess = 8,
+	kDescribeBatch_MaxProcesses = 4,
+};
+
 b32 p4_describe_task_count(void)
 {
-	return s_taskDescribeChangelistCount;
+	u32 count = s_taskDescribeChangelistCount;
+	for(u32 i = 0; i < kP4TaskPriority_Count; ++i) {
+		count += s_describes.queued[i].count + s_shelvedDescribes.queued[i].count;
+	}
+	return count;
+}
+
+static p4InFlightChange *p4_find_in_flight_change(p4InFlightChanges *inFlight, u32 number)
+{
+	for(u32 i = 0; i < inFlight->count; ++i) {
+		if(inFlight->data[i].number == number) {
+			return inFlight->data + i;
+		}
+	}
+	return NULL;
+}
+
+static void p4_queue_change_number(p4DescribeQueue *queue, p4TaskPriority priority, u32 number)
+{
+	const p4ViewIds *views = p4_task_current_views();
+	p4InFlightChange *inFlight = p4_find_in_flight_change(&queue->inFlight, number);
+	if(inFlight) {
+		BB_LOG("p4::dedupe", "describe %u is already in flight", number);
+		p4_task_add_request_views(inFlight->requestId, views);
+		return;
+	}
+	if(!views->count) {
+		p4_view_ids_add(queue->views + priority, 0);
+	}
+	p4_view_ids_add_all(queue->views + priority, views);
+	for(u32 queueIndex = 0; queueIndex < kP4TaskPriority_Count; ++queueIndex) {
+		p4ChangeNumbers *numbers = queue->queued + queueIndex;
+		for(u32 i = 0; i < numbers->count; ++i) {
+			if(numbers->data[i] == number) {
+				if(queueIndex <= priority) {
+					return;
+				}
+				bba_erase(*numbers, i);
+				p4_view_ids_add_all(queue->views + priority, queue->views + queueIndex);
+				break;
+			}
+		}
+	}
+	bba_push(queue->queued[priority], number);
+}
+
+static void p4_release_change_numbers(p4DescribeQueue *queue, task_p4 *p)
+{
+	const char *cursor = sdict_find_safe(&p->extraData, "changes");
+	span_t token = tokenize(&cursor, " ");
+	while(token.start) {
+		u32 number = strtou32(token.start);
+		p4InFlightChange *inFlight = p4_find_in_flight_change(&queue->inFlight, number);
+		if(inFlight) {
+			bba_erase(queue->inFlight, (u32)(inFlight - queue->inFlight.data));
+		}
+		token = tokenize(&cursor, " ");
+	}
+}
+
+// the store key time for a describe result: 0 for submitted changelists, the update time for
+// pending ones, or ~0u if the result shouldn't be stored (a pending change we have no time for)
+static u32 p4_describe_store_time(const sdict_t *sd, u32 change)
+{
+	if(!strcmp(sdict_find_safe(sd, "status"), "submitted")) {
+		return 0;
+	}
+	u32 time = p4_pending_change_time(change);
+	return time ? time : ~0u;
+}
+
+static void p4_describe_store_result(p4DescribeStoreKind kind, const sdict_t *sd)
+{
+	u32 change = strtou32(sdict_find_safe(sd, "change"));
+	u32 time = change ? p4_describe_store_time(sd, change) : ~0u;
+	if(time != ~0u) {
+		p4_describe_store_save(kind, change, time, sd);
+	}
+}
+
+static p4TaskPriority p4_describe_priority(task_p4 *p)
+{
+	const char *priority = sdict_find(&p->extraData, "priority");
+	return priority ? (p4TaskPriority)strtou32(priority) : kP4TaskPriority_Visible;
+}
+
+static void p4_flush_change_numbers(p4DescribeQueue *queue, p4TaskPriority priority, const char *name, Task_StateChanged *statechanged, p4Task_Dropped *dropped, const char *command)
+{
+	p4ChangeNumbers *numbers = queue->queued + priority;
+	p4ViewIds *views = queue->views + priority;
+	if(!numbers->count) {
+		views->count = 0;
+		return;
+	}
+
+	u32 numProcesses = (numbers->count + kDescribeBatch_MinArgsPerProcess - 1) / kDescribeBatch_MinArgsPerProcess;
+	numProcesses = BB_CLAMP(numProcesses, 1, kDescribeBatch_MaxProcesses);
+	u32 argsPerProcess = (numbers->count + numProcesses - 1) / numProcesses;
+	for(u32 start = 0; start < numbers->count; start += argsPerProcess) {
+		sbs_t args = { 0 };
+		sb_t changes = { 0 };
+		for(u32 i = start; i < numbers->count && i < start + argsPerProcess; ++i) {
+			sb_t arg = { 0 };
+			sb_va(&arg, "%u", numbers->data[i]);
+			bba_push(args, arg);
+			sb_va(&changes, "%s%u", changes.count ? " " : "", numbers->data[i]);
+		}
+		sdict_t extraData = { 0 };
+		sdict_add_raw(&extraData, "priority", va("%u", priority));
+		sdict_add_raw(&extraData, "changes", sb_get(&changes));
+		task t = p4_task_create_batch(name, statechanged, p4_dir(), &extraData, &args, "%s", command);
+		p4_task_set_dropped(&t, dropped);
+		task_p4 *p = t.taskData;
+		if(p4_task_queue_for_views(priority, t, views)) {
+			++s_taskDescribeChangelistCount;
+			for(u32 i = start; i < numbers->count && i < start + argsPerProcess; ++i) {
+				p4InFlightChange inFlight = { numbers->data[i], p->requestId };
+				bba_push(queue->inFlight, inFlight);
+			}
+		}
+		sb_reset(&changes);
+		sbs_reset(&args);
+	}
+	numbers->count = 0;
+	views->count = 0;
 }
 
 static void task_describe_changelist_statechanged_fstat_shelved(task *t)
@@ -31,45 +192,63 @@ static void task_describe_changelist_statechanged_fstat_shelved(task *t)
 		}
 	}
 }
+static void p4_describe_changelist_shelved_record(sdict_t *sd, p4TaskPriority priority)
+{
+	u32 changeNumber = strtou32(sdict_find_safe(sd, "change"));
+	if(!changeNumber)
+		return;
+
+	p4Changelist *cl = p4_find_changelist(changeNumber);
+	if(cl) {
+		sdict_move(&cl->shelved, sd);
+		++cl->parity;
+	} else if(bba_add(p4.changelists, 1)) {
+		cl = &bba_last(p4.changelists);
+		cl->number = changeNumber;
+		cl->parity = 1;
+		sdict_move(&cl->shelved, sd);
+	}
+	if(cl) {
+		const char *clientName = sdict_find_safe(&cl->normal, "client");
+		sdict_t extraData = { 0 };
+		sdict_add_raw(&extraData, "change", va("%u", changeNumber));
+		p4_task_queue(priority, p4_task_create(
+		    "describe_changelist_shelved_files",
+		    task_describe_changelist_statechanged_fstat_shelved, p4_dir(), &extraData,
+		    "\"%s\" -G -c %s fstat -Op -Rs -e %u //%s/...", p4_exe(), clientName, changeNumber, clientName));
+	}
+}
 static void task_describe_changelist_statechanged_desc_shelved(task *t)
 {
 	task_process_statechanged(t);
 	if(t->state == kTaskState_Succeeded) {
 		task_p4 *p = t->taskData;
-		if(p->parsedDicts.count == 1) {
-			u32 changeNumber = strtou32(sdict_find_safe(p->parsedDicts.data, "change"));
-			if(changeNumber) {
-				sdictEntry_t e = { 0 };
-				sb_append(&e.key, "change");
-				sb_va(&e.value, va("%u", changeNumber));
-				sdict_add(&p->extraData, &e);
-				p4Changelist *cl = p4_find_changelist(changeNumber);
-				if(cl) {
-					sdict_move(&cl->shelved, p->parsedDicts.data);
-					++cl->parity;
-				} else if(bba_add(p4.changelists, 1)) {
-					cl = &bba_last(p4.changelists);
-					cl->number = changeNumber;
-					cl->parity = 1;
-					sdict_move(&cl->shelved, p->parsedDicts.data);
-				}
-				if(cl) {
-					const char *clientName = sdict_find_safe(&cl->normal, "client");
-					task_queue(p4_task_create(
-					    "describe_changelist_shelved_files",
-					    task_describe_changelist_statechanged_fstat_shelved, p4_dir(), &p->extraData,
-					    "\"%s\" -G -c %s fstat -Op -Rs -e %u //%s/...", p4_exe(), clientName, changeNumber, clientName));
-				}
-			}
+		p4TaskPriority priority = p4_describe_priority(p);
+		for(u32 i = 0; i < p->parsedDicts.count; ++i) {
+			p4_describe_store_result(kP4DescribeStore_Shelved, p->parsedDicts.data + i);
+			p4_describe_changelist_shelved_record(p->parsedDicts.data + i, priority);
 		}
 	}
+	if(task_done(t)) {
+		p4_release_change_numbers(&s_shelvedDescribes, t->taskData);
+		--s_taskDescribeChangelistCount;
+	}
 }
-static void spawn_describe_shelved(p4Changelist *cl, task_p4 *p)
+static void task_describe_changelist_dropped_desc_shelved(task_p4 *p)
 {
-	task_queue(p4_task_create(
-	    "describe_changelist_shelved",
-	    task_describe_changelist_statechanged_desc_shelved, p4_dir(), &p->extraData,
-	    "\"%s\" -G describe -s -S %u", p4_exe(), cl->number));
+	p4_release_change_numbers(&s_shelvedDescribes, p);
+	--s_taskDescribeChangelistCount;
+}
+static void spawn_describe_shelved(p4Changelist *cl, p4TaskPriority priority)
+{
+	u32 time = p4_pending_change_time(cl->number);
+	sdict_t sd = { 0 };
+	if(time && p4_describe_store_load(kP4DescribeStore_Shelved, cl->number, time, &sd)) {
+		p4_describe_changelist_shelved_record(&sd, priority);
+		sdict_reset(&sd);
+		return;
+	}
+	p4_queue_change_number(&s_shelvedDescribes, priority, cl->number);
 }
 static void task_describe_changelist_statechanged_fstat_normal(task *t)
 {
@@ -83,66 +262,103 @@ static void task_describe_changelist_statechanged_fstat_normal(task *t)
 				sdicts_move(&cl->normalFiles, &p->parsedDicts);
 				++cl->parity;
 				if(sdict_find(&cl->normal, "shelved")) {
-					spawn_describe_shelved(cl, p);
+					spawn_describe_shelved(cl, p4_describe_priority(p));
 				}
 			}
 		}
 	}
 }
-static void spawn_fstat_normal(p4Changelist *cl, task_p4 *p)
+static void spawn_fstat_normal(p4Changelist *cl, p4TaskPriority priority)
 {
 	const char *clientName = sdict_find_safe(&cl->normal, "client");
-	task_queue(p4_task_create(
+	sdict_t extraData = { 0 };
+	sdict_add_raw(&extraData, "change", va("%u", cl->number));
+	sdict_add_raw(&extraData, "priority", va("%u", priority));
+	p4_task_queue(priority, p4_task_create(
 	    "describe_changelist_files",
-	    task_describe_changelist_statechanged_fstat_normal, p4_dir(), &p->extraData,
+	    task_describe_changelist_statechanged_fstat_normal, p4_dir(), &extraData,
 	    "\"%s\" -G -c %s fstat -Olhp -Rco -e %u //%s/...", p4_exe(), clientName, cl->number, clientName));
 }
+static void p4_describe_changelist_record(sdict_t *sd, p4TaskPriority priority)
+{
+	u32 changeNumber = strtou32(sdict_find_safe(sd, "change"));
+	if(!changeNumber)
+		return;
+
+	p4Changelist *cl = p4_find_changelist(changeNumber);
+	if(cl) {
+		sdict_move(&cl->normal, sd);
+		++cl->parity;
+	} else if(bba_add(p4.changelists, 1)) {
+		cl = &bba_last(p4.changelists);
+		cl->number = changeNumber;
+		cl->parity = 1;
+		sdict_move(&cl->normal, sd);
+	}
+	if(cl) {
+		cl->client = p4_intern(sdict_find_safe(&cl->normal, "client"));
+		p4ChangelistType cltype = p4_get_changelist_type(cl);
+		if(cltype == kChangelistType_PendingLocal && sdict_find(&cl->normal, "depotFile0")) {
+			spawn_fstat_normal(cl, priority);
+		} else if(sdict_find(&cl->normal, "shelved")) {
+			spawn_describe_shelved(cl, priority);
+		}
+	}
+}
 static void task_describe_changelist_statechanged_desc(task *t)
 {
 	task_process_statechanged(t);
 	if(t->state == kTaskState_Succeeded) {
 		task_p4 *p = t->taskData;
-		if(p->parsedDicts.count == 1) {
-			u32 changeNumber = strtou32(sdict_find_safe(p->parsedDicts.data, "change"));
-			if(changeNumber) {
-				sdictEntry_t e = { 0 };
-				sb_append(&e.key, "change");
-				sb_va(&e.value, va("%u", changeNumber));
-				sdict_add(&p->extraData, &e);
-				p4Changelist *cl = p4_find_changelist(changeNumber);
-				if(cl) {
-					sdict_move(&cl->normal, p->parsedDicts.data);
-					++cl->parity;
-				} else if(bba_add(p4.changelists, 1)) {
-					cl = &bba_last(p4.changelists);
-					cl->number = changeNumber;
-					cl->parity = 1;
-					sdict_move(&cl->normal, p->parsedDicts.data);
-				}
-				if(cl) {
-					p4ChangelistType cltype = p4_get_changelist_type(&cl->normal);
-					if(cltype == kChangelistType_PendingLocal && sdict_find(&cl->normal, "depotFile0")) {
-						spawn_fstat_normal(cl, p);
-					} else if(sdict_find(&cl->normal, "shelved")) {
-						spawn_describe_shelved(cl, p);
-					}
-				}
-			}
+		p4TaskPriority priority = p4_describe_priority(p);
+		for(u32 i = 0; i < p->parsedDicts.count; ++i) {
+			p4_describe_store_result(kP4DescribeStore_Describe, p->parsedDicts.data + i);
+			p4_describe_changelist_record(p->parsedDicts.data + i, priority);
 		}
 	}
 	if(task_done(t)) {
+		p4_release_change_numbers(&s_describes, t->taskData);
 		--s_taskDescribeChangelistCount;
 	}
 }
-void p4_describe_changelist(u32 cl)
+static void task_describe_changelist_dropped_desc(task_p4 *p)
+{
+	p4_release_change_numbers(&s_describes, p);
+	--s_taskDescribeChangelistCount;
+}
+void p4_describe_changelist(u32 cl, p4TaskPriority priority)
+{
+	// submitted entries are stored with time 0, so a pending change only matches its current version
+	sdict_t sd = { 0 };
+	if(p4_describe_store_load(kP4DescribeStore_Describe, cl, p4_pending_change_time(cl), &sd)) {
+		p4_describe_changelist_record(&sd, priority);
+		sdict_reset(&sd);
+		return;
+	}
+	p4_queue_change_number(&s_describes, priority, cl);
+}
+
+void p4_describe_flush(void)
+{
+	for(u32 i = 0; i < kP4TaskPriority_Count; ++i) {
+		p4TaskPriority priority = (p4TaskPriority)i;
+		p4_flush_change_numbers(&s_describes, priority, "describe_changelist", task_describe_changelist_statechanged_desc, task_describe_changelist_dropped_desc, "describe -s");
+		p4_flush_change_numbers(&s_shelvedDescribes, priority, "describe_changelist_shelved", task_describe_changelist_statechanged_desc_shelved,
+		                        task_describe_changelist_dropped_desc_shelved, "describe -s -S");
+	}
+}
+
+void p4_describe_shutdown(void)
 {
-	task *t = task_queue(p4_task_create(
-	    "describe_changelist",
-	    task_describe_changelist_statechanged_desc, p4_dir(), NULL,
-	    "\"%s\" -G describe -s %u", p4_exe(), cl));
-	if(t) {
-		++s_taskDescribeChangelistCount;
+	for(u32 i = 0; i < kP4TaskPriority_Count; ++i) {
+		bba_free(s_describes.queued[i]);
+		bba_free(s_shelvedDescribes.queued[i]);
+		bba_free(s_describes.views[i]);
+		bba_free(s_shelvedDescribes.views[i]);
 	}
+	bba_free(s_describes.inFlight);
+	bba_free(s_shelvedDescribes.inFlight);
+	p4_describe_store_shutdown();
 }
 
 static void task_describe_default_changelist_statechanged(task *t)
@@ -150,7 +366,7 @@ static void task_describe_default_changelist_statechanged(task *t)
 	task_process_statechanged(t);
 	if(t->state == kTaskState_Succeeded) {
 		task_p4 *p = t->taskData;
-		const char *client = sdict_find_safe(&t->extraData, "client");
+		const char *client = sdict_find_safe(&p->extraData, "client");
 		p4Changelist *cl = p4_find_default_changelist(client);
 		if(cl) {
 			++cl->parity;
@@ -161,7 +377,8 @@ static void task_describe_default_changelist_statechanged(task *t)
 		}
 		if(cl) {
 			p4_reset_changelist(cl);
-			p4_build_default_changelist(&cl->normal, sdict_find_safe(&t->extraData, "user"), client);
+			p4_build_default_changelist(&cl->normal, sdict_find_safe(&p->extraData, "user"), client);
+			cl->client = p4_intern(client);
 			sdicts_move(&cl->normalFiles, &p->parsedDicts);
 			for(u32 fileIdx = 0; fileIdx < cl->normalFiles.count; ++fileIdx) {
 				sdict_t *f = cl->normalFiles.data + fileIdx;
@@ -183,6 +400,11 @@ static void task_describe_default_changelist_statechanged(task *t)
 		--s_taskDescribeChangelistCount;
 	}
 }
+static void task_describe_default_changelist_dropped(task_p4 *p)
+{
+	BB_UNUSED(p);
+	--s_taskDescribeChangelistCount;
+}
 void p4_describe_default_changelist(const char *client)
 {
 	const char *localHost = sdict_find_safe(&p4.info, "clientHost");
@@ -192,22 +414,22 @@ void p4_describe_default_changelist(const char *client)
 		if(!strcmp(sdict_find_safe(sd, "client"), client)) {
 			const char *user = sdict_find_safe(sd, "Owner");
 			const char *host = sdict_find_safe(sd, "Host");
-			task *t;
+			sdict_t extraData = { 0 };
+			sdict_add_raw(&extraData, "client", client);
+			sdict_add_raw(&extraData, "user", user);
+			task t;
 			if(!_stricmp(user, localUser) && !_stricmp(host, localHost)) {
 				// default changelist for a local clientspec
-				t = task_queue(p4_task_create(
-				    "describe_default_local",
-				    task_describe_default_changelist_statechanged, p4_dir(), NULL,
-				    "\"%s\" -G -c %s fstat -Olhp -Rco -e default //%s/...", p4_exe(), client, client));
+				t = p4_task_create("describe_default_local",
+				                   task_describe_default_changelist_statechanged, p4_dir(), &extraData,
+				                   "\"%s\" -G -c %s fstat -Olhp -Rco -e default //%s/...", p4_exe(), client, client);
 			} else {
-				t = task_queue(p4_task_create(
-				    "describe_default_remote",
-				    task_describe_default_changelist_statechanged, p4_dir(), NULL,
-				    "\"%s\" -G opened -C %s -c default", p4_exe(), client));
+				t = p4_task_create("describe_default_remote",
+				                   task_describe_default_changelist_statechanged, p4_dir(), &extraData,
+				                   "\"%s\" -G opened -C %s -c default", p4_exe(), client);
 			}
-			if(t) {
-				sdict_add_raw(&t->extraData, "client", client);
-				sdict_add_raw(&t->extraData, "user", user);
+			p4_task_set_dropped(&t, task_describe_default_changelist_dropped);
+			if(p4_task_queue(kP4TaskPriority_Visible, t) == kP4TaskQueue_Queued) {
 				++s_taskDescribeChangelistCount;
 			}
 			break;
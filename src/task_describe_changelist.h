@@ -4,14 +4,17 @@
 #pragma once
 
 #include "common.h"
+#include "p4_task.h"
 
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
-void p4_describe_changelist(u32 cl);
+void p4_describe_changelist(u32 cl, p4TaskPriority priority);
 void p4_describe_default_changelist(const char *client);
 b32 p4_describe_task_count(void);
+void p4_describe_flush(void);
+void p4_describe_shutdown(void);
 
 #if defined(__cplusplus)
 }
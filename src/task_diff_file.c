@@ -12,211 +12,378 @@
 #include "path_utils.h"
 #include "process_task.h"
 #include "str.h"
+#include "thread_task.h"
 #include "va.h"
 
-static sbs_t s_diffFiles;
+#include <stdlib.h>
+
+// Depot revisions printed for diffs are kept in a blob cache per server and user, shared across
+// sessions.  A specific revision (#N) never changes, so a blob that is already there is reused
+// instead of printing it again.  Blobs are touched when used, and the least recently used are
+// trimmed once the cache grows past g_config.p4.blobCacheMaxMB.  Anything else (shelved files,
+// @=N, #have) can't be reused, so it is printed to a unique name in a per-session temp directory
+// that is removed at shutdown.
+enum {
+	kBlobCache_StaleTempSeconds = 24 * 60 * 60, // temp files older than this are from an interrupted print
+};
+
+static sbs_t s_diffFiles; // printed revisions that can change, deleted at shutdown
 static sbs_t s_diffDirs;
 static u32 s_diffCount;
+static sb_t s_blobCacheDir;
+static b32 s_blobCacheTrimming;
+static b32 s_blobCacheTrimQueued;
 
-const char *diff_exe(void)
+typedef struct tag_diffBlob {
+	sb_t path;
+	b32 cached;
+	u8 pad[4];
+} diffBlob;
+
+static b32 p4_diff_revision_is_immutable(const char *rev)
 {
-	if(g_config.diff.enabled && g_config.diff.path.count) {
-		return g_config.diff.path.data;
+	if(*rev++ != '#' || !*rev) {
+		return false;
 	}
-	const char *diffExe = sdict_find(&p4.set, "P4DIFF");
-	if(diffExe)
-		return diffExe;
-	diffExe = p4_exe();
-	const char *end = strrchr(diffExe, '\\');
-	if(end) {
-		return va("%.*s\\p4merge.exe", end - diffExe, diffExe);
+	for(; *rev; ++rev) {
+		if(*rev < '0' || *rev > '9') {
+			return false;
+		}
 	}
-	return "";
+	return true;
 }
 
-void p4_diff_against_local(const char *depotPath, const char *rev, const char *localPath, b32 depotFirst)
+static u64 p4_diff_blob_hash(u64 hash, const char *str)
 {
+	for(; *str; ++str) {
+		hash = (hash ^ (u8)*str) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static void p4_diff_blob_touch(const char *path)
+{
+	HANDLE handle = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(handle != INVALID_HANDLE_VALUE) {
+		FILETIME now;
+		GetSystemTimeAsFileTime(&now);
+		SetFileTime(handle, NULL, NULL, &now);
+		CloseHandle(handle);
+	}
+}
+
+static const char *p4_diff_blob_dir(void)
+{
+	sb_t dir = p4_cache_shard_path("p4_blobs", NULL);
+	if(strcmp(sb_get(&dir), sb_get(&s_blobCacheDir))) {
+		path_mkdir(sb_get(&dir));
+		sb_reset(&s_blobCacheDir);
+		s_blobCacheDir = dir;
+	} else {
+		sb_reset(&dir);
+	}
+	return sb_get(&s_blobCacheDir);
+}
+
+// path is empty if depotPath has no filename
+static diffBlob p4_diff_blob(const char *depotPath, const char *rev)
+{
+	diffBlob blob = { 0 };
 	const char *filename = strrchr(depotPath, '/');
 	if(!filename++)
-		return;
+		return blob;
 
 	const char *ext = strrchr(filename, '.');
+	if(!p4_diff_revision_is_immutable(rev)) {
+		sb_t temp = env_get("TEMP");
+		if(!temp.data)
+			return blob;
+		sb_t diffDir = { 0 };
+		sb_va(&diffDir, "%s\\p4t\\%u\\%u", sb_get(&temp), GetCurrentProcessId(), s_diffCount++);
+		if(ext > filename) {
+			sb_va(&blob.path, "%s\\%.*s%s%s", sb_get(&diffDir), ext - filename, filename, rev, ext);
+		} else {
+			sb_va(&blob.path, "%s\\%s%s", sb_get(&diffDir), filename, rev);
+		}
+		sb_reset(&temp);
+		bba_push(s_diffDirs, diffDir);
+		sb_t diffFile = { 0 };
+		sb_append(&diffFile, sb_get(&blob.path));
+		bba_push(s_diffFiles, diffFile);
+		return blob;
+	}
 
-	sb_t temp = env_get("TEMP");
-	if(!temp.data)
-		return;
-
-	DWORD procId = GetCurrentProcessId();
-	sb_t diffDir = { 0 }, target = { 0 };
-	sb_va(&diffDir, "%s\\p4t\\%u\\%u", sb_get(&temp), procId, s_diffCount);
+	u64 hash = p4_diff_blob_hash(p4_diff_blob_hash(0xcbf29ce484222325ull, depotPath), rev);
+	const char *dir = p4_diff_blob_dir();
 	if(ext > filename) {
-		sb_va(&target, "%s\\%.*s%s%s", sb_get(&diffDir), ext - filename, filename, rev, ext);
+		sb_va(&blob.path, "%s\\%016llx_%.*s%s%s", dir, hash, ext - filename, filename, rev, ext);
 	} else {
-		sb_va(&target, "%s\\%s%s", sb_get(&diffDir), filename, rev);
+		sb_va(&blob.path, "%s\\%016llx_%s%s", dir, hash, filename, rev);
 	}
-	sb_reset(&temp);
-	++s_diffCount;
+	if(file_readable(sb_get(&blob.path))) {
+		p4_diff_blob_touch(sb_get(&blob.path));
+		blob.cached = true;
+	}
+	return blob;
+}
 
-	const char *p4dir = p4_dir();
-	const char *p4exe = p4_exe();
-	const char *diffExe = diff_exe();
+typedef struct tag_blobCacheEntry {
+	u64 lastWrite;
+	u64 size;
+	sb_t path;
+} blobCacheEntry;
 
-	task t = { 0 };
-	t.tick = task_tick_subtasks;
-	sb_append(&t.name, "diff_against_local");
-	bba_push(t.subtasks, p4_task_create(va("diff_fetch_%s%s", depotPath, rev), task_process_statechanged, p4dir, NULL,
-	                                    "\"%s\" -G print -o %s %s%s",
-	                                    p4exe, sb_get(&target), depotPath, rev));
-	bba_push(t.subtasks, process_task_create("diff", kProcessSpawn_OneShot, p4dir,
-	                                         "\"%s\" \"%s\" \"%s\"",
-	                                         diffExe, (depotFirst) ? sb_get(&target) : localPath,
-	                                         (depotFirst) ? localPath : sb_get(&target)));
-	task_queue(t);
+typedef struct tag_blobCacheEntries {
+	u32 count;
+	u32 allocated;
+	blobCacheEntry *data;
+} blobCacheEntries;
 
-	bba_push(s_diffDirs, diffDir);
-	bba_push(s_diffFiles, target);
+static int p4_diff_blob_entry_compare(const void *_a, const void *_b)
+{
+	const blobCacheEntry *a = _a;
+	const blobCacheEntry *b = _b;
+	return (a->lastWrite < b->lastWrite) ? 1 : (a->lastWrite > b->lastWrite) ? -1 : 0; // newest first
 }
 
-void p4_diff_against_depot(const char *depotPathA, const char *revA, const char *depotPathB, const char *revB)
+static void p4_diff_blob_delete(const char *path)
 {
-	const char *filenameA = strrchr(depotPathA, '/');
-	const char *filenameB = strrchr(depotPathB, '/');
-	if(!filenameA++ || !filenameB++)
-		return;
+	SetFileAttributesA(path, FILE_ATTRIBUTE_NORMAL); // printed files can be read-only
+	file_delete(path);
+}
 
-	sb_t temp = env_get("TEMP");
-	if(!temp.data)
-		return;
+typedef struct tag_blobCacheTrim {
+	sb_t dir;
+	u64 maxBytes; // read from the config on the main thread - 0 is unlimited
+} blobCacheTrim;
+
+static bb_thread_return_t p4_diff_trim_blob_cache_thread(void *args)
+{
+	task_thread *th = args;
+	blobCacheTrim *trim = th->data;
+	const char *dir = sb_get(&trim->dir);
 
-	const char *extA = strrchr(filenameA, '.');
-	const char *extB = strrchr(filenameB, '.');
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	u64 nowTime = ((u64)now.dwHighDateTime << 32) | now.dwLowDateTime;
+	u64 staleTempTime = (u64)kBlobCache_StaleTempSeconds * 10000000ull; // FILETIME is in 100ns units
 
-	DWORD procId = GetCurrentProcessId();
-	sb_t diffDir = { 0 }, targetA = { 0 }, targetB = { 0 };
-	sb_va(&diffDir, "%s\\p4t\\%u\\%u", sb_get(&temp), procId, s_diffCount);
-	if(extA > filenameA) {
-		sb_va(&targetA, "%s\\%.*s%s%s", sb_get(&diffDir), extA - filenameA, filenameA, revA, extA);
-	} else {
-		sb_va(&targetA, "%s\\%s%s", sb_get(&diffDir), filenameA, revA);
+	blobCacheEntries entries = { 0 };
+	WIN32_FIND_DATAA find;
+	HANDLE handle = FindFirstFileA(va("%s\\*", dir), &find);
+	if(handle != INVALID_HANDLE_VALUE) {
+		do {
+			if(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+				continue;
+			}
+			u64 lastWrite = ((u64)find.ftLastWriteTime.dwHighDateTime << 32) | find.ftLastWriteTime.dwLowDateTime;
+			const char *ext = strrchr(find.cFileName, '.');
+			if(ext && !strcmp(ext, ".tmp")) {
+				// a print might still be writing it
+				if(nowTime > lastWrite && nowTime - lastWrite > staleTempTime) {
+					p4_diff_blob_delete(va("%s\\%s", dir, find.cFileName));
+				}
+				continue;
+			}
+			if(bba_add(entries, 1)) {
+				blobCacheEntry *entry = &bba_last(entries);
+				entry->lastWrite = lastWrite;
+				entry->size = ((u64)find.nFileSizeHigh << 32) | find.nFileSizeLow;
+				sb_va(&entry->path, "%s\\%s", dir, find.cFileName);
+			}
+		} while(!th->shouldTerminate && FindNextFileA(handle, &find));
+		FindClose(handle);
+	}
+
+	if(entries.count) {
+		qsort(entries.data, entries.count, sizeof(blobCacheEntry), p4_diff_blob_entry_compare);
+	}
+	u64 total = 0;
+	u32 numDeleted = 0;
+	for(u32 i = 0; i < entries.count; ++i) {
+		blobCacheEntry *entry = entries.data + i;
+		total += entry->size;
+		if(trim->maxBytes && total > trim->maxBytes && !th->shouldTerminate) {
+			p4_diff_blob_delete(sb_get(&entry->path));
+			++numDeleted;
+		}
+		sb_reset(&entry->path);
+	}
+	if(numDeleted) {
+		BB_LOG("p4::diff", "trimmed %u of %u blobs from %s", numDeleted, entries.count, dir);
+	}
+	bba_free(entries);
+
+	th->threadDesiredState = kTaskState_Succeeded;
+	return 0;
+}
+
+static void p4_diff_trim_blob_cache(void);
+static void p4_diff_trim_blob_cache_statechanged(task *t)
+{
+	task_thread_statechanged(t);
+	if(task_done(t)) {
+		task_thread *th = t->taskData;
+		blobCacheTrim *trim = th->data;
+		sb_reset(&trim->dir);
+		free(trim);
+		th->data = NULL;
+		s_blobCacheTrimming = false;
+		if(s_blobCacheTrimQueued) {
+			s_blobCacheTrimQueued = false;
+			p4_diff_trim_blob_cache();
+		}
 	}
-	if(extB > filenameB) {
-		sb_va(&targetB, "%s\\%.*s%s%s", sb_get(&diffDir), extB - filenameB, filenameB, revB, extB);
+}
+
+static void p4_diff_trim_blob_cache(void)
+{
+	if(s_blobCacheTrimming) {
+		s_blobCacheTrimQueued = true;
+		return;
+	}
+	blobCacheTrim *trim = malloc(sizeof(blobCacheTrim));
+	if(!trim) {
+		return;
+	}
+	memset(trim, 0, sizeof(blobCacheTrim));
+	sb_append(&trim->dir, p4_diff_blob_dir());
+	trim->maxBytes = (u64)g_config.p4.blobCacheMaxMB * 1024 * 1024;
+	if(task_queue(thread_task_create("trim_blob_cache", p4_diff_trim_blob_cache_statechanged, p4_diff_trim_blob_cache_thread, trim))) {
+		s_blobCacheTrimming = true;
 	} else {
-		sb_va(&targetB, "%s\\%s%s", sb_get(&diffDir), filenameB, revB);
+		sb_reset(&trim->dir);
+		free(trim);
+	}
+}
+
+// p4 print writes to a temp name that is renamed once it completes, so an interrupted print
+// never leaves a partial blob that later diffs would reuse
+static void p4_diff_fetch_statechanged(task *t)
+{
+	task_process_statechanged(t);
+	if(task_done(t)) {
+		task_p4 *p = t->taskData;
+		const char *temp = sdict_find_safe(&p->extraData, "temp");
+		const char *target = sdict_find_safe(&p->extraData, "target");
+		if(t->state == kTaskState_Succeeded && file_readable(temp)) {
+			if(!MoveFileExA(temp, target, MOVEFILE_REPLACE_EXISTING)) {
+				BB_ERROR("p4::diff", "failed to move %s to %s", temp, target);
+				p4_diff_blob_delete(temp);
+			}
+		} else {
+			p4_diff_blob_delete(temp);
+		}
+		p4_diff_trim_blob_cache();
 	}
+}
+
+static void p4_diff_push_fetch(task *t, const char *depotPath, const char *rev, const diffBlob *blob)
+{
+	if(blob->cached)
+		return;
+
+	sb_t temp = { 0 };
+	sb_va(&temp, "%s.tmp", sb_get(&blob->path));
+	sdict_t extraData = { 0 };
+	sdict_add_raw(&extraData, "target", sb_get(&blob->path));
+	sdict_add_raw(&extraData, "temp", sb_get(&temp));
+	bba_push(t->subtasks, p4_task_create(va("diff_fetch_%s%s", depotPath, rev), p4_diff_fetch_statechanged, p4_dir(), &extraData,
+	                                     "\"%s\" -G print -o \"%s\" %s%s",
+	                                     p4_exe(), sb_get(&temp), depotPath, rev));
 	sb_reset(&temp);
-	++s_diffCount;
+}
+
+const char *diff_exe(void)
+{
+	if(g_config.diff.enabled && g_config.diff.path.count) {
+		return g_config.diff.path.data;
+	}
+	const char *diffExe = sdict_find(&p4.set, "P4DIFF");
+	if(diffExe)
+		return diffExe;
+	diffExe = p4_exe();
+	const char *end = strrchr(diffExe, '\\');
+	if(end) {
+		return va("%.*s\\p4merge.exe", end - diffExe, diffExe);
+	}
+	return "";
+}
 
-	const char *p4dir = p4_dir();
-	const char *p4exe = p4_exe();
-	const char *diffExe = diff_exe();
+void p4_diff_against_local(const char *depotPath, const char *rev, const char *localPath, b32 depotFirst)
+{
+	diffBlob blob = p4_diff_blob(depotPath, rev);
+	if(!blob.path.data)
+		return;
 
+	const char *target = sb_get(&blob.path);
 	task t = { 0 };
-	sb_append(&t.name, "diff_against_depot");
 	t.tick = task_tick_subtasks;
-	bba_push(t.subtasks, p4_task_create(va("diff_fetch_%s%s", depotPathA, revA), task_process_statechanged, p4dir, NULL,
-	                                    "\"%s\" -G print -o %s %s%s",
-	                                    p4exe, sb_get(&targetA), depotPathA, revA));
-	bba_push(t.subtasks, p4_task_create(va("diff_fetch_%s%s", depotPathB, revB), task_process_statechanged, p4dir, NULL,
-	                                    "\"%s\" -G print -o %s %s%s",
-	                                    p4exe, sb_get(&targetB), depotPathB, revB));
-	bba_push(t.subtasks, process_task_create("diff", kProcessSpawn_OneShot, p4dir,
+	sb_append(&t.name, "diff_against_local");
+	p4_diff_push_fetch(&t, depotPath, rev, &blob);
+	bba_push(t.subtasks, process_task_create("diff", kProcessSpawn_OneShot, p4_dir(),
 	                                         "\"%s\" \"%s\" \"%s\"",
-	                                         diffExe, sb_get(&targetA), sb_get(&targetB)));
-	task_queue(t);
-
-	bba_push(s_diffDirs, diffDir);
-	bba_push(s_diffFiles, targetA);
-	bba_push(s_diffFiles, targetB);
-}
-
-typedef struct tag_diffDepotStrings {
-	const char *filename;
-	const char *ext;
-	sb_t target;
-} diffDepotStrings;
-
-static diffDepotStrings p4_diff_get_depotLocations(const char *diffDir, const char *srcPath, const char *srcRevision, b32 isDepotPath)
-{
-	diffDepotStrings out = { 0 };
-	if(isDepotPath) {
-		out.filename = strrchr(srcPath, '/');
-		if(!out.filename++)
-			return out;
-		out.ext = strrchr(out.filename, '.');
-		if(out.ext > out.filename) {
-			sb_va(&out.target, "%s\\%.*s%s%s", diffDir, out.ext - out.filename, out.filename, srcRevision, out.ext);
-		} else {
-			sb_va(&out.target, "%s\\%s%s", diffDir, out.filename, srcRevision);
-		}
-	} else {
-		sb_append(&out.target, srcPath);
+	                                         diff_exe(), (depotFirst) ? target : localPath,
+	                                         (depotFirst) ? localPath : target));
+	p4_task_queue(kP4TaskPriority_Interactive, t);
+	sb_reset(&blob.path);
+}
+
+void p4_diff_against_depot(const char *depotPathA, const char *revA, const char *depotPathB, const char *revB)
+{
+	diffBlob blobA = p4_diff_blob(depotPathA, revA);
+	diffBlob blobB = p4_diff_blob(depotPathB, revB);
+	if(blobA.path.data && blobB.path.data) {
+		task t = { 0 };
+		sb_append(&t.name, "diff_against_depot");
+		t.tick = task_tick_subtasks;
+		p4_diff_push_fetch(&t, depotPathA, revA, &blobA);
+		p4_diff_push_fetch(&t, depotPathB, revB, &blobB);
+		bba_push(t.subtasks, process_task_create("diff", kProcessSpawn_OneShot, p4_dir(),
+		                                         "\"%s\" \"%s\" \"%s\"",
+		                                         diff_exe(), sb_get(&blobA.path), sb_get(&blobB.path)));
+		p4_task_queue(kP4TaskPriority_Interactive, t);
 	}
-	return out;
+	sb_reset(&blobA.path);
+	sb_reset(&blobB.path);
 }
 
-void p4_diff_file_locators(const p4FileLocator *locatorA, const p4FileLocator *locatorB)
+static diffBlob p4_diff_locator_blob(const p4FileLocator *locator)
 {
-	sb_t temp = env_get("TEMP");
-	if(!temp.data)
-		return;
+	if(locator->depotPath) {
+		return p4_diff_blob(sb_get(&locator->path), sb_get(&locator->revision));
+	}
+	diffBlob blob = { 0 };
+	sb_append(&blob.path, sb_get(&locator->path));
+	blob.cached = true; // local files are diffed in place
+	return blob;
+}
 
-	DWORD procId = GetCurrentProcessId();
-	sb_t diffDir = { 0 };
-	sb_va(&diffDir, "%s\\p4t\\%u\\%u", sb_get(&temp), procId, s_diffCount++);
-
-	const char *depotPathA = sb_get(&locatorA->path);
-	const char *revA = sb_get(&locatorA->revision);
-	const char *depotPathB = sb_get(&locatorB->path);
-	const char *revB = sb_get(&locatorB->revision);
-	diffDepotStrings strA = p4_diff_get_depotLocations(sb_get(&diffDir), depotPathA, revA, locatorA->depotPath);
-	diffDepotStrings strB = p4_diff_get_depotLocations(sb_get(&diffDir), depotPathB, revB, locatorB->depotPath);
-
-	if(strA.target.data && strB.target.data) {
-		const char *p4dir = p4_dir();
-		const char *p4exe = p4_exe();
-		const char *diffExe = diff_exe();
+void p4_diff_file_locators(const p4FileLocator *locatorA, const p4FileLocator *locatorB)
+{
+	diffBlob blobA = p4_diff_locator_blob(locatorA);
+	diffBlob blobB = p4_diff_locator_blob(locatorB);
+	if(blobA.path.data && blobB.path.data) {
 		task t = { 0 };
 		sb_append(&t.name, "diff_against_depot");
 		t.tick = task_tick_subtasks;
-		if(locatorA->depotPath) {
-			bba_push(t.subtasks, p4_task_create(va("diff_fetch_%s%s", depotPathA, revA), task_process_statechanged, p4dir, NULL,
-			                                    "\"%s\" -G print -o %s %s%s",
-			                                    p4exe, sb_get(&strA.target), depotPathA, revA));
-		}
-		if(locatorB->depotPath) {
-			bba_push(t.subtasks, p4_task_create(va("diff_fetch_%s%s", depotPathB, revB), task_process_statechanged, p4dir, NULL,
-			                                    "\"%s\" -G print -o %s %s%s",
-			                                    p4exe, sb_get(&strB.target), depotPathB, revB));
-		}
-		bba_push(t.subtasks, process_task_create("diff", kProcessSpawn_OneShot, p4dir,
+		p4_diff_push_fetch(&t, sb_get(&locatorA->path), sb_get(&locatorA->revision), &blobA);
+		p4_diff_push_fetch(&t, sb_get(&locatorB->path), sb_get(&locatorB->revision), &blobB);
+		bba_push(t.subtasks, process_task_create("diff", kProcessSpawn_OneShot, p4_dir(),
 		                                         "\"%s\" \"%s\" \"%s\"",
-		                                         diffExe, sb_get(&strA.target), sb_get(&strB.target)));
-		bba_push(s_diffDirs, diffDir);
-		if(locatorA->depotPath) {
-			bba_push(s_diffFiles, strA.target);
-		} else {
-			sb_reset(&strA.target);
-		}
-		if(locatorB->depotPath) {
-			bba_push(s_diffFiles, strB.target);
-		} else {
-			sb_reset(&strB.target);
-		}
-		task_queue(t);
-	} else {
-		sb_reset(&diffDir);
-		sb_reset(&strA.target);
-		sb_reset(&strB.target);
+		                                         diff_exe(), sb_get(&blobA.path), sb_get(&blobB.path)));
+		p4_task_queue(kP4TaskPriority_Interactive, t);
 	}
-
-	sb_reset(&temp);
+	sb_reset(&blobA.path);
+	sb_reset(&blobB.path);
 }
 
 void p4_diff_shutdown(void)
 {
+	sb_reset(&s_blobCacheDir);
+
 	for(u32 i = 0; i < s_diffFiles.count; ++i) {
-		file_delete(sb_get(s_diffFiles.data + i));
+		p4_diff_blob_delete(sb_get(s_diffFiles.data + i));
 	}
 	sbs_reset(&s_diffFiles);
 
@@ -225,8 +392,7 @@ void p4_diff_shutdown(void)
 	}
 	sbs_reset(&s_diffDirs);
 
-	DWORD procId = GetCurrentProcessId();
-	sb_t dir = env_resolve(va("%%TEMP%%\\p4t\\diff\\%u", procId));
+	sb_t dir = env_resolve(va("%%TEMP%%\\p4t\\%u", GetCurrentProcessId()));
 	path_rmdir(sb_get(&dir));
 	sb_reset(&dir);
 }
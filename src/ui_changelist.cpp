@@ -539,7 +539,7 @@ b32 UIChangelist_DrawFiles(uiChangelistFiles *files, p4Changelist *cl, float ind
 	}
 	ImGui::NewLine();
 
-	p4ChangelistType cltype = p4_get_changelist_type(&cl->normal);
+	p4ChangelistType cltype = p4_get_changelist_type(cl);
 
 	const float itemPad = ImGui::GetStyle().ItemSpacing.x;
 	for(u32 i = 0; i < files->count; ++i) {
@@ -572,7 +572,7 @@ b32 UIChangelist_DrawFilesNoColumns(uiChangelistFiles *files, p4Changelist *cl,
 
 	b32 anyActive = false;
 
-	p4ChangelistType cltype = p4_get_changelist_type(&cl->normal);
+	p4ChangelistType cltype = p4_get_changelist_type(cl);
 
 	const float itemPad = ImGui::GetStyle().ItemSpacing.x;
 	for(u32 i = 0; i < files->count; ++i) {
@@ -620,7 +620,9 @@ static void UIChangelist_MessageBoxCallback(messageBox *mb, const char *action)
 			if(testChangelist > 0) {
 				uicl->config.number = (u32)testChangelist;
 				uicl->displayed = 0;
-				p4_describe_changelist(uicl->config.number);
+				p4_task_set_view(uicl->id);
+				p4_describe_changelist(uicl->config.number, kP4TaskPriority_Visible);
+				p4_task_set_view(0);
 			}
 		}
 	}
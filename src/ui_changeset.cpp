@@ -72,14 +72,14 @@ static sb_t UIChangeset_CopySelectedToBuffer(p4UIChangeset *uics, p4Changeset *c
 		p4UIChangesetSortKey *s = uics->sorted.data + i;
 		p4UIChangesetEntry *e = uics->entries.data + s->entryIndex;
 		if(e->selected) {
-			sdict_t *c = cs->changelists.data + e->changelistIndex;
-			if(c) {
+			if(e->changelistIndex < cs->changelists.count) {
 				for(u32 col = 0; col < data->numColumns; ++col) {
 					if(data->columnNames[col]) {
 						const changesetColumnField *field = p4.changesetColumnFields + col;
-						const char *value = sdict_find_safe(c, field->key);
+						char buffer[16];
+						const char *value = p4_changelist_table_string(&cs->changelists, e->changelistIndex, field->column, buffer, sizeof(buffer));
 						if(field->type == kChangesetColumn_Time) {
-							u32 time = strtou32(value);
+							u32 time = cs->changelists.time[e->changelistIndex];
 							value = time ? Time_StringFromEpochTime(time) : "";
 						}
 						sb_t singleLine = { 0 };
@@ -210,7 +210,9 @@ static void UIChangeset_HandleClick(p4UIChangeset *uics, u32 index)
 				UITabs_AddTab(kTabType_Changelist, uicl->id);
 				uicl->config.number = e->changelistNumber;
 				uicl->displayed = 0;
-				p4_describe_changelist(uicl->config.number);
+				p4_task_set_view(uicl->id);
+				p4_describe_changelist(uicl->config.number, kP4TaskPriority_Visible);
+				p4_task_set_view(0);
 			}
 		}
 	}
@@ -361,15 +363,119 @@ void UIChangeset_Menu()
 	ImGui::Checkbox("DEBUG Changeset Optimizations", &s_debug.showChangesetOptimizations);
 }
 
-static bool UIChangeset_TryAddChangelist(p4UIChangeset *uics, p4Changeset *cs, u32 index)
+enum changesetNameFlag {
+	kChangesetNameFlag_User = 0x1,
+	kChangesetNameFlag_Client = 0x2,
+	kChangesetNameFlag_Checked = 0x80,
+};
+
+enum {
+	kChangesetNameCache_Buckets = 1024,
+	kChangesetNameCache_MaxProbes = 16,
+};
+
+struct changesetNameCacheEntry {
+	p4InternId id;
+	u32 flags; // changesetNameFlag, or 0 for an empty bucket
+};
+
+// The auto filter (required user/client) is case-insensitive, so each distinct interned name is
+// compared against the filter tokens once per pass and the result cached by id.  The per-row
+// check is then a couple of probes.  Only the manual filter needs an sdict view of the row.
+struct changesetFilterPass {
+	sdict_t view;
+	p4UIChangeset *uics;
+	changesetNameCacheEntry *nameCache;
+	u32 requiredFlags;
+	u8 pad[4];
+};
+
+static void UIChangeset_BeginFilterPass(changesetFilterPass *pass, p4UIChangeset *uics)
+{
+	memset(pass, 0, sizeof(*pass));
+	pass->uics = uics;
+	for(u32 i = 0; i < uics->autoFilterTokens.count; ++i) {
+		const char *category = sb_get(&uics->autoFilterTokens.data[i].category);
+		if(!strcmp(category, "user")) {
+			pass->requiredFlags |= kChangesetNameFlag_User;
+		} else if(!strcmp(category, "client")) {
+			pass->requiredFlags |= kChangesetNameFlag_Client;
+		}
+	}
+	if(pass->requiredFlags) {
+		pass->nameCache = (changesetNameCacheEntry *)calloc(kChangesetNameCache_Buckets, sizeof(changesetNameCacheEntry));
+	}
+}
+
+static void UIChangeset_EndFilterPass(changesetFilterPass *pass)
 {
-	sdict_t *sd = cs->changelists.data + index;
-	if(UIChangeset_PassesFilter(&uics->autoFilterTokens, sd) && UIChangeset_PassesFilter(&uics->manualFilterTokens, sd)) {
+	p4_record_view_reset(&pass->view);
+	free(pass->nameCache);
+	pass->nameCache = NULL;
+}
+
+static u32 UIChangeset_MatchName(const p4UIChangeset *uics, p4InternId id)
+{
+	u32 flags = kChangesetNameFlag_Checked;
+	const char *name = p4_intern_string(id);
+	for(u32 i = 0; i < uics->autoFilterTokens.count; ++i) {
+		const filterToken *token = uics->autoFilterTokens.data + i;
+		if(!_stricmp(name, sb_get(&token->text))) {
+			const char *category = sb_get(&token->category);
+			if(!strcmp(category, "user")) {
+				flags |= kChangesetNameFlag_User;
+			} else if(!strcmp(category, "client")) {
+				flags |= kChangesetNameFlag_Client;
+			}
+		}
+	}
+	return flags;
+}
+
+static u32 UIChangeset_NameFlags(changesetFilterPass *pass, p4InternId id)
+{
+	if(pass->nameCache) {
+		u32 mask = kChangesetNameCache_Buckets - 1;
+		u32 bucket = (id * 2654435761u) & mask;
+		for(u32 probe = 0; probe < kChangesetNameCache_MaxProbes; ++probe, bucket = (bucket + 1) & mask) {
+			changesetNameCacheEntry *entry = pass->nameCache + bucket;
+			if(!entry->flags) {
+				entry->id = id;
+				entry->flags = UIChangeset_MatchName(pass->uics, id);
+				return entry->flags;
+			}
+			if(entry->id == id) {
+				return entry->flags;
+			}
+		}
+	}
+	return UIChangeset_MatchName(pass->uics, id);
+}
+
+static bool UIChangeset_PassesFilterPass(changesetFilterPass *pass, p4UIChangeset *uics, p4ChangelistTable *table, u32 row)
+{
+	if(pass->requiredFlags) {
+		u32 flags = UIChangeset_NameFlags(pass, table->user[row]) & kChangesetNameFlag_User;
+		flags |= UIChangeset_NameFlags(pass, table->client[row]) & kChangesetNameFlag_Client;
+		if((flags & pass->requiredFlags) != pass->requiredFlags) {
+			return false;
+		}
+	}
+	if(uics->manualFilterTokens.count) {
+		p4_changelist_table_view(table, row, &pass->view);
+		return UIChangeset_PassesFilter(&uics->manualFilterTokens, &pass->view);
+	}
+	return true;
+}
+
+static bool UIChangeset_TryAddChangelist(p4UIChangeset *uics, p4Changeset *cs, u32 index, changesetFilterPass *pass)
+{
+	if(UIChangeset_PassesFilterPass(pass, uics, &cs->changelists, index)) {
 		p4UIChangesetEntry e = {};
-		e.changelistNumber = strtou32(sdict_find_safe(sd, "change"));
+		e.changelistNumber = cs->changelists.change[index];
 		e.changelistIndex = index;
 		e.selected = false;
-		sb_append(&e.client, sdict_find_safe(sd, "client"));
+		e.client = cs->changelists.client[index];
 		if(bba_add_noclear(uics->entries, 1)) {
 			bba_last(uics->entries) = e;
 			return true;
@@ -378,6 +484,59 @@ static bool UIChangeset_TryAddChangelist(p4UIChangeset *uics, p4Changeset *cs, u
 	return false;
 }
 
+// A refresh that patched rows in place (see p4ChangelistPatch) is followed entry by entry, so
+// selection, expanded files and measured heights survive it.  Returns false if the view has to
+// be rebuilt instead.
+static bool UIChangeset_ApplyPatch(p4UIChangeset *uics, p4Changeset *cs)
+{
+	const p4ChangelistPatch *patch = &cs->patch;
+	u8 *present = (u8 *)calloc(BB_MAX(patch->newCount, 1u), 1);
+	if(!patch->remap || !present) {
+		free(present);
+		return false;
+	}
+	// surviving rows keep their order, so the rows this view had seen are still a prefix
+	u32 appended = 0;
+	for(u32 row = 0; row < uics->numChangelistsAppended && row < patch->oldCount; ++row) {
+		if(patch->remap[row] != ~0u) {
+			++appended;
+		}
+	}
+
+	changesetFilterPass pass;
+	UIChangeset_BeginFilterPass(&pass, uics);
+	u32 dst = 0;
+	for(u32 i = 0; i < uics->entries.count; ++i) {
+		p4UIChangesetEntry *e = uics->entries.data + i;
+		u32 row = (e->changelistIndex < patch->oldCount) ? patch->remap[e->changelistIndex] : ~0u;
+		if(row != ~0u && patch->modified[row]) {
+			if(UIChangeset_PassesFilterPass(&pass, uics, &cs->changelists, row)) {
+				e->height = 0.0f; // the description may have changed
+			} else {
+				row = ~0u;
+			}
+		}
+		if(row == ~0u) {
+			p4_reset_uichangesetentry(e);
+			continue;
+		}
+		e->changelistIndex = row;
+		present[row] = true;
+		uics->entries.data[dst++] = *e;
+	}
+	uics->entries.count = dst;
+	// changed rows the filter used to hide may pass now
+	for(u32 row = 0; row < appended; ++row) {
+		if(patch->modified[row] && !present[row]) {
+			UIChangeset_TryAddChangelist(uics, cs, row, &pass);
+		}
+	}
+	UIChangeset_EndFilterPass(&pass);
+	free(present);
+	uics->numChangelistsAppended = appended; // rows added by the refresh are appended below
+	return true;
+}
+
 void UIChangeset_Update(p4UIChangeset *uics)
 {
 	ImGui::PushID(uics);
@@ -462,7 +621,8 @@ void UIChangeset_Update(p4UIChangeset *uics)
 		ImGui::BeginTooltip();
 		ImGui::TextUnformatted("Filter: +<Category:>RequireThis -<Category:>WithoutThis <Category:>AtLeast <Category:>OneOfTheseOrRequireThis");
 		ImGui::Separator();
-		ImGui::TextUnformatted("Categories: user, client, desc");
+		ImGui::TextUnformatted("Categories: user, client, desc, path");
+		ImGui::TextUnformatted("path: is applied by the server to submitted changes, and matches changes under any of the given depot paths.");
 		ImGui::TextUnformatted("Category can be omitted, and the filter component will be applied to all categories.");
 		ImGui::Separator();
 		ImGui::TextUnformatted("Examples:");
@@ -472,20 +632,58 @@ void UIChangeset_Update(p4UIChangeset *uics)
 		ImGui::EndTooltip();
 	}
 
-	p4Changeset *cs = p4_find_or_add_changeset(uics->config.pending);
+	const char *clientspec = sb_get(&uics->config.clientspec);
+	if(!strcmp(clientspec, "Current Client")) {
+		clientspec = p4_clientspec();
+	}
+	if(uics->parity == 0 || forceRebuild) {
+		// the pending list is small and reconciled in place, so only submitted views get their own result set
+		sb_t serverFilter = {};
+		if(!uics->config.pending) {
+			p4_build_changes_filter(&serverFilter, NULL, user, clientspec, uics->config.filterEnabled ? sb_get(&uics->config.filter) : "");
+		}
+		if(strcmp(sb_get(&serverFilter), sb_get(&uics->serverFilter))) {
+			forceRebuild = true;
+		}
+		sb_reset(&uics->serverFilter);
+		uics->serverFilter = serverFilter;
+	}
+
+	p4Changeset *cs = p4_find_or_add_changeset_for_view(uics);
 	if(!cs) {
 		ImGui::PopID();
 		return;
 	}
 
 	if(!cs->refreshed) {
+		p4_task_set_view(uics->id);
 		p4_refresh_changeset(cs);
+		p4_task_set_view(0);
+	}
+	if(cs->stale) {
+		ImGui::SameLine();
+		ImGui::TextDisabled(cs->updating ? "(cached - refreshing)" : "(cached)");
+	}
+	if(cs->fetchingHistory) {
+		ImGui::SameLine();
+		ImGui::TextDisabled("(loading older changes)");
 	}
 
-	u32 paritySort = cs->parity;
+	b32 patched = false;
+	if(uics->patchCount != cs->patchCount) {
+		if(uics->parity == cs->parity && !forceRebuild && uics->patchCount + 1 == cs->patchCount && UIChangeset_ApplyPatch(uics, cs)) {
+			patched = true;
+		} else {
+			forceRebuild = true;
+		}
+		uics->patchCount = cs->patchCount;
+	}
+
+	u32 paritySort = patched ? 0 : cs->parity;
 
 	if(uics->parity != cs->parity || forceRebuild) {
 		uics->parity = cs->parity;
+		uics->patchCount = cs->patchCount;
 		uics->numChangelistsAppended = cs->changelists.count;
 		paritySort = 0;
 		BB_LOG("changeset::rebuild_changeset", "rebuild tokens");
@@ -493,24 +691,25 @@ void UIChangeset_Update(p4UIChangeset *uics)
 		//p4UIChangeset old = *uics; // TODO: retain selection when refreshing changelists
 
 		if(uics->config.filterEnabled) {
-			build_filter_tokens(&uics->manualFilterTokens, sb_get(&uics->config.filter));
+			sb_t clientFilter = {};
+			p4_build_changes_filter(NULL, &clientFilter, "", "", sb_get(&uics->config.filter));
+			build_filter_tokens(&uics->manualFilterTokens, sb_get(&clientFilter));
+			sb_reset(&clientFilter);
 		} else {
 			reset_filter_tokens(&uics->manualFilterTokens);
 		}
 
+		// user and client are already applied by the server when the view has its own result set
 		reset_filter_tokens(&uics->autoFilterTokens);
-		if(*user) {
+		b32 serverFiltered = sb_len(&uics->serverFilter) != 0;
+		if(*user && !serverFiltered) {
 			if(filterToken *t = add_filter_token(&uics->autoFilterTokens, "user", user)) {
 				t->required = true;
 				t->prohibited = false;
 				t->exact = true;
 			}
 		}
-		const char *clientspec = sb_get(&uics->config.clientspec);
-		if(*clientspec) {
-			if(!strcmp(clientspec, "Current Client")) {
-				clientspec = p4_clientspec();
-			}
+		if(*clientspec && !serverFiltered) {
 			if(filterToken *t = add_filter_token(&uics->autoFilterTokens, "client", clientspec)) {
 				t->required = true;
 				t->prohibited = false;
@@ -525,22 +724,16 @@ void UIChangeset_Update(p4UIChangeset *uics)
 		uics->entries.count = 0;
 		uics->sorted.count = 0;
 		BB_LOG("changeset::rebuild_changeset", "adding new entries");
+		changesetFilterPass pass;
+		UIChangeset_BeginFilterPass(&pass, uics);
 		for(u32 i = 0; i < cs->changelists.count; ++i) {
-			sdict_t *sd = cs->changelists.data + i;
-			if(UIChangeset_PassesFilter(&uics->autoFilterTokens, sd) && UIChangeset_PassesFilter(&uics->manualFilterTokens, sd)) {
-				p4UIChangesetEntry e = {};
-				e.changelistNumber = strtou32(sdict_find_safe(sd, "change"));
-				e.changelistIndex = i;
-				e.selected = false;
-				sb_append(&e.client, sdict_find_safe(sd, "client"));
-				if(bba_add_noclear(uics->entries, 1)) {
-					bba_last(uics->entries) = e;
-					p4UIChangesetSortKey s = {};
-					s.entryIndex = uics->sorted.count;
-					bba_push(uics->sorted, s);
-				}
+			if(UIChangeset_TryAddChangelist(uics, cs, i, &pass)) {
+				p4UIChangesetSortKey s = {};
+				s.entryIndex = uics->sorted.count;
+				bba_push(uics->sorted, s);
 			}
 		}
+		UIChangeset_EndFilterPass(&pass);
 		UIChangeset_SetWindowTitle(uics);
 		BB_LOG("changeset::rebuild_changeset", "done");
 	}
@@ -570,11 +763,14 @@ void UIChangeset_Update(p4UIChangeset *uics)
 
 	if(uics->numChangelistsAppended < cs->changelists.count) {
 		BB_LOG("changeset::append_changeset", "start append");
+		changesetFilterPass pass;
+		UIChangeset_BeginFilterPass(&pass, uics);
 		for(u32 i = uics->numChangelistsAppended; i < cs->changelists.count; ++i) {
-			if(UIChangeset_TryAddChangelist(uics, cs, i)) {
+			if(UIChangeset_TryAddChangelist(uics, cs, i, &pass)) {
 				paritySort = 0;
 			}
 		}
+		UIChangeset_EndFilterPass(&pass);
 		uics->numChangelistsAppended = cs->changelists.count;
 		BB_LOG("changeset::append_changeset", "end append");
 	}
@@ -662,15 +858,14 @@ void UIChangeset_Update(p4UIChangeset *uics)
 			p4UIChangesetEntry *e = uics->entries.data + s->entryIndex;
 			e->startY = ImGui::GetCursorPosY();
 			uics->numValidStartY = BB_MAX(uics->numValidStartY, i);
-			sdict_t *c = cs->changelists.data + e->changelistIndex;
-			if(c) {
-				b32 expanded = ImGui::TreeNode(va("###node%u%s", e->changelistNumber, sb_get(&e->client)));
+			if(e->changelistIndex < cs->changelists.count) {
+				b32 expanded = ImGui::TreeNode(va("###node%u%s", e->changelistNumber, p4_intern_string(e->client)));
 				if(expanded) {
 					ImGui::TreePop();
 				}
 				ImGui::SameLine();
 				ImGui::PushSelectableColors(e->selected, ImGui::IsActiveSelectables(uics));
-				ImGui::Selectable(va("###%u%s", e->changelistNumber, sb_get(&e->client)), e->selected != 0);
+				ImGui::Selectable(va("###%u%s", e->changelistNumber, p4_intern_string(e->client)), e->selected != 0);
 				ImGui::PopSelectableColors(e->selected, ImGui::IsActiveSelectables(uics));
 				if(ImGui::IsItemActive()) {
 					anyActive = true;
@@ -706,7 +901,11 @@ void UIChangeset_Update(p4UIChangeset *uics)
 				ImVec2 pos = ImGui::GetIconPosForText();
 				pos.x -= iconWidth * 0.5f;
 				ImColor iconColor;
-				switch(p4_get_changelist_type(c)) {
+				p4ChangelistType cltype = kChangelistType_Submitted;
+				if(cs->changelists.status[e->changelistIndex] == kP4ChangelistStatus_Pending) {
+					cltype = (e->client != p4_clientspec_id()) ? kChangelistType_PendingOther : kChangelistType_PendingLocal;
+				}
+				switch(cltype) {
 				case kChangelistType_PendingLocal:
 					iconColor = COLOR_PENDING_CHANGELIST_LOCAL;
 					break;
@@ -729,9 +928,10 @@ void UIChangeset_Update(p4UIChangeset *uics)
 				for(u32 col = 0; col < data.numColumns; ++col) {
 					if(data.columnNames[col]) {
 						const changesetColumnField *field = p4.changesetColumnFields + col;
-						const char *value = sdict_find_safe(c, field->key);
+						char buffer[16];
+						const char *value = p4_changelist_table_string(&cs->changelists, e->changelistIndex, field->column, buffer, sizeof(buffer));
 						if(field->type == kChangesetColumn_Time) {
-							u32 time = strtou32(value);
+							u32 time = cs->changelists.time[e->changelistIndex];
 							value = time ? Time_StringFromEpochTime(time) : "";
 						}
 						sb_t singleLine = { 0 };
@@ -752,7 +952,7 @@ void UIChangeset_Update(p4UIChangeset *uics)
 					}
 				}
 				if(expanded) {
-					p4Changelist *cl = e->changelistNumber ? p4_find_changelist(e->changelistNumber) : p4_find_default_changelist(sb_get(&e->client));
+					p4Changelist *cl = e->changelistNumber ? p4_find_changelist(e->changelistNumber) : p4_find_default_changelist(p4_intern_string(e->client));
 					if(cl) {
 						if(e->parity != cl->parity) {
 							e->parity = cl->parity;
@@ -780,11 +980,13 @@ void UIChangeset_Update(p4UIChangeset *uics)
 					} else {
 						if(!e->described) {
 							e->described = true;
+							p4_task_set_view(uics->id);
 							if(e->changelistNumber) {
-								p4_describe_changelist(e->changelistNumber);
+								p4_describe_changelist(e->changelistNumber, kP4TaskPriority_Visible);
 							} else {
-								p4_describe_default_changelist(sb_get(&e->client));
+								p4_describe_default_changelist(p4_intern_string(e->client));
 							}
+							p4_task_set_view(0);
 						}
 					}
 				}
@@ -826,6 +1028,12 @@ void UIChangeset_Update(p4UIChangeset *uics)
 		if(debug) {
 			BB_LOG("changeset::rebuild_offsets", "end rebuild_offsets");
 		}
+
+		// older history is fetched a page at a time as the end of the list comes into view - with
+		// a filter that matches little, that keeps paging until the list fills
+		if(!cs->pending && ImGui::GetScrollY() + ImGui::GetWindowHeight() * 2.0f >= ImGui::GetScrollMaxY()) {
+			p4_request_older_changes(cs);
+		}
 	}
 	ImGui::EndChild();
 
@@ -853,7 +1061,9 @@ void UIChangeset_Update(p4UIChangeset *uics)
 	}
 
 	if(key_is_pressed_this_frame(Key_F5) && !io.KeyCtrl && !io.KeyShift && !io.KeyAlt) {
+		p4_task_set_view(uics->id);
 		p4_request_newer_changes(cs, g_config.p4.changelistBlockSize);
+		p4_task_set_view(0);
 	}
 
 	ImGui::PopID();
@@ -20,14 +20,14 @@ const char *UIClientspec_DefaultClientspecName()
 
 const char *UIClientspec_ClientspecName(u32 i)
 {
-	return sdict_find_safe(p4.localClients.data + i, "client");
+	return sdict_find_safe(p4.allClients.data + p4.localClients.data[i], "client");
 }
 
 const char *UIClientspec_ActiveClientspecName()
 {
 	const char *configClientspec = sb_get(&g_config.p4.clientspec);
 	for(u32 i = 0; i < p4.localClients.count; ++i) {
-		if(!strcmp(configClientspec, sdict_find_safe(p4.localClients.data + i, "client"))) {
+		if(!strcmp(configClientspec, sdict_find_safe(p4.allClients.data + p4.localClients.data[i], "client"))) {
 			return configClientspec;
 		}
 	}
@@ -46,7 +46,7 @@ void UIClientspec_MenuBar()
 			p4_set_clientspec(nullptr);
 		}
 		for(u32 i = 0; i < p4.localClients.count; ++i) {
-			const char *clientspec = sdict_find_safe(p4.localClients.data + i, "client");
+			const char *clientspec = sdict_find_safe(p4.allClients.data + p4.localClients.data[i], "client");
 			if(ImGui::MenuItem(clientspec)) {
 				p4_set_clientspec(clientspec);
 			}
@@ -7,6 +7,7 @@
 #include "imgui_core.h"
 #include "imgui_themes.h"
 #include "imgui_utils.h"
+#include "va.h"
 
 static config_t *s_uiConfig;
 static config_t s_config;
@@ -164,6 +165,36 @@ void UIConfig_Update(config_t *config)
 			s_config.p4.changelistBlockSize = (u32)val;
 			ImGui::SameLine();
 			ImGui::TextUnformatted("(0 fetches all)");
+			static const char *s_taskPriorityNames[] = {
+				"Interactive",
+				"Visible",
+				"Prefetch",
+				"Background",
+			};
+			BB_CTASSERT(BB_ARRAYSIZE(s_taskPriorityNames) == BB_ARRAYSIZE(s_config.p4.maxTasksInFlight));
+			ImGui::TextUnformatted("Max running p4 commands (0 is unlimited):");
+			for(u32 i = 0; i < BB_ARRAYSIZE(s_config.p4.maxTasksInFlight); ++i) {
+				ImGui::AlignTextToFramePadding();
+				ImGui::TextUnformatted(va("  %s:", s_taskPriorityNames[i]));
+				ImGui::SameLine();
+				ImGui::PushItemWidth(100.0f * g_config.dpiScale);
+				val = (int)s_config.p4.maxTasksInFlight[i];
+				ImGui::InputInt(va("##maxTasksInFlight%u", i), &val, 1, 4);
+				val = BB_CLAMP(val, 0, 64);
+				s_config.p4.maxTasksInFlight[i] = (u32)val;
+				ImGui::PopItemWidth();
+			}
+			ImGui::AlignTextToFramePadding();
+			ImGui::TextUnformatted("Diff blob cache size (MB):");
+			ImGui::SameLine();
+			ImGui::PushItemWidth(100.0f * g_config.dpiScale);
+			val = (int)s_config.p4.blobCacheMaxMB;
+			ImGui::InputInt("##blobCacheMaxMB", &val, 64, 512);
+			val = BB_CLAMP(val, 0, 1024 * 1024);
+			s_config.p4.blobCacheMaxMB = (u32)val;
+			ImGui::PopItemWidth();
+			ImGui::SameLine();
+			ImGui::TextUnformatted("(0 keeps everything)");
 			ImGui::PopID();
 		}
 		ImGui::Separator();
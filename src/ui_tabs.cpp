@@ -111,7 +111,9 @@ void UITabs_LoadConfig(tabs *ts)
 				uicl->config = tc->cl;
 				memset(&tc->cl, 0, sizeof(tc->cl));
 				if(uicl->config.number) {
-					p4_describe_changelist(uicl->config.number);
+					p4_task_set_view(uicl->id);
+					p4_describe_changelist(uicl->config.number, (i == g_config.activeTab) ? kP4TaskPriority_Visible : kP4TaskPriority_Prefetch);
+					p4_task_set_view(0);
 				}
 			}
 		}
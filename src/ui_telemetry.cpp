@@ -0,0 +1,111 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#include "ui_telemetry.h"
+#include "appdata.h"
+#include "imgui_utils.h"
+#include "p4_telemetry.h"
+#include "tasks.h"
+#include "va.h"
+
+static bool s_showTelemetry;
+static p4TaskMetrics s_entries[kP4Telemetry_MaxEntries];
+
+void UITelemetry_Menu()
+{
+	ImGui::Checkbox("DEBUG p4 Task Telemetry", &s_showTelemetry);
+}
+
+static const char *UITelemetry_StateName(const p4TaskMetrics *entry)
+{
+	if(!entry->doneTicks) {
+		return entry->startTicks ? "running" : "queued";
+	}
+	switch(entry->state) {
+	case kTaskState_Succeeded:
+		return "succeeded";
+	case kTaskState_Failed:
+		return "failed";
+	case kTaskState_Canceled:
+		return "canceled";
+	default:
+		return "done";
+	}
+}
+
+// milliseconds between two marks, or blank if either hasn't happened yet
+static const char *UITelemetry_Interval(u64 start, u64 end)
+{
+	return (start && end >= start) ? va("%.1f", p4_telemetry_ms(end - start)) : "";
+}
+
+static void UITelemetry_ExportChromeTrace()
+{
+	sb_t path = appdata_get("p4t");
+	sb_append(&path, "\\p4_trace.json");
+	p4_telemetry_write_chrome_trace(sb_get(&path));
+	sb_reset(&path);
+}
+
+void UITelemetry_Update()
+{
+	if(!s_showTelemetry) {
+		return;
+	}
+	if(ImGui::Begin("p4 Task Telemetry", &s_showTelemetry)) {
+		if(ImGui::Button("Export chrome://tracing JSON")) {
+			UITelemetry_ExportChromeTrace();
+		}
+		if(ImGui::IsItemHovered()) {
+			ImGui::SetTooltip("Writes p4_trace.json to the p4t appdata directory");
+		}
+		ImGui::SameLine();
+		if(ImGui::Button("Clear")) {
+			p4_telemetry_clear();
+		}
+
+		u32 count = p4_telemetry_snapshot(s_entries, kP4Telemetry_MaxEntries);
+		u64 now = p4_telemetry_ticks();
+		const char *headers[] = { "task", "state", "pri", "queued ms", "spawn ms", "first byte ms", "total ms", "KB", "records", "parse ms", "callback ms" };
+		ImGui::Columns(BB_ARRAYSIZE(headers), "telemetry");
+		for(u32 i = 0; i < BB_ARRAYSIZE(headers); ++i) {
+			ImGui::TextUnformatted(headers[i]);
+			ImGui::NextColumn();
+		}
+		ImGui::Separator();
+
+		// newest first
+		for(u32 i = count; i-- > 0;) {
+			const p4TaskMetrics *entry = s_entries + i;
+			u64 end = entry->doneTicks ? entry->doneTicks : now;
+			u64 spawned = entry->spawnedTicks ? entry->spawnedTicks : entry->startTicks;
+			ImGui::TextUnformatted(entry->name);
+			if(ImGui::IsItemHovered()) {
+				ImGui::SetTooltip("%s", entry->command);
+			}
+			ImGui::NextColumn();
+			ImGui::TextUnformatted(UITelemetry_StateName(entry));
+			ImGui::NextColumn();
+			ImGui::Text("%u", entry->priority);
+			ImGui::NextColumn();
+			ImGui::TextUnformatted(UITelemetry_Interval(entry->queuedTicks, entry->startTicks ? entry->startTicks : end));
+			ImGui::NextColumn();
+			ImGui::TextUnformatted(UITelemetry_Interval(entry->startTicks, entry->spawnedTicks));
+			ImGui::NextColumn();
+			ImGui::TextUnformatted(UITelemetry_Interval(spawned, entry->firstByteTicks));
+			ImGui::NextColumn();
+			ImGui::TextUnformatted(UITelemetry_Interval(entry->queuedTicks, end));
+			ImGui::NextColumn();
+			ImGui::Text("%.1f", (double)entry->bytes / 1024.0);
+			ImGui::NextColumn();
+			ImGui::Text("%u", entry->records);
+			ImGui::NextColumn();
+			ImGui::Text("%.1f", p4_telemetry_ms(entry->parseTicks));
+			ImGui::NextColumn();
+			ImGui::Text("%.1f", p4_telemetry_ms(entry->callbackTicks));
+			ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
+	ImGui::End();
+}
@@ -0,0 +1,9 @@
+// Copyright (c) 2012-2018 Matt Campbell
+// MIT license (see License.txt)
+
+#pragma once
+
+#include "common.h"
+
+void UITelemetry_Menu();
+void UITelemetry_Update();